@@ -0,0 +1,21 @@
+#include "Framebuffer.h"
+
+Framebuffer::Framebuffer(int w, int h, ThreadPool& pool_) : pool(pool_)
+{
+	this->width = w;
+	this->height = h;
+	this->pixels.resize(3 * (size_t)w * h);
+}
+
+void Framebuffer::for_rows(function<void(int)> fn)
+{
+	/* one task per row, the pool hands them out as threads free up */
+	this->pool.run(this->height, fn);
+}
+
+bool Framebuffer::write(ofstream& outf)
+{
+	outf << create_ppm_header("P6", this->width, this->height, 255);
+	outf.write((char*)this->pixels.data(), this->pixels.size());
+	return (bool)outf;
+}
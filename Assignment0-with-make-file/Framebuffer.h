@@ -0,0 +1,66 @@
+#ifndef FRAMEBUFFER_H_
+#define FRAMEBUFFER_H_
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+#include "utils.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+/*
+	The whole image in memory, filled in by rows and written out in one go
+	-> every generator fills it through for_rows(), so they all get
+		spread over the program's one thread pool without doing
+		anything special
+	-> pixels are 8 bit rgb, written as a binary P6 file
+*/
+class Framebuffer
+{
+public:
+	/* the pool's size only changes the speed, the image is the same for any count */
+	Framebuffer(int w, int h, ThreadPool& pool);
+
+	/*
+		Same as the old put(), values are cut to ints,
+		 and anything outside 0 to 255 gets clamped
+	*/
+	void put(int row, int col, float r, float g, float b)
+	{
+		uint8_t* p = &this->pixels[3 * ((size_t)row * this->width + col)];
+		p[0] = channel(r);
+		p[1] = channel(g);
+		p[2] = channel(b);
+	}
+
+	/*
+		Calls fn(row) once for every row.
+		Threads grab the next unfinished row as they go, so rows
+		 that take longer (perlin in the combo) don't hold one thread up.
+		fn has to be fine with being called from several threads,
+		 writing only its own row is.
+	*/
+	void for_rows(function<void(int)> fn);
+
+	/* header and all the pixels in a single write */
+	bool write(ofstream& outf);
+
+	int width, height;
+
+private:
+	static uint8_t channel(float v)
+	{
+		int i = (int)v;
+		return i < 0 ? 0 : (i > 255 ? 255 : i);
+	}
+
+	ThreadPool& pool;
+	vector<uint8_t> pixels;
+};
+
+#endif
@@ -1,12 +1,62 @@
 #include "PerlinNoise.h"
 
+/* points done per block in the batch versions */
+static const int BATCH = 64;
+
+static inline float grad_f(int h, float x, float y, float z)
+{
+	float u = h < 8 ? x : y;
+	float v = h < 4 ? y : ((h == 12 || h == 14) ? x : z);
+	return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+static inline float lerp_f(float t, float a, float b)
+{
+	return a + t * (b - a);
+}
+
+/*
+	The math half of the batch noise, everything after the table lookups
+	fx, fy, fz are the positions inside the lattice cell and
+	 h[c * BATCH + i] is the gradient hash for corner c of point i
+	No lookups and no real branches (the ?: turn into selects),
+	 so this loop vectorizes, the lookups can't and are done before
+*/
+static void noise_kernel(
+	const float* __restrict fx, const float* __restrict fy, const float* __restrict fz,
+	const int* __restrict h, float* __restrict out, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		float x = fx[i], y = fy[i], z = fz[i];
+
+		float u = x * x * x * (x * (x * 6 - 15) + 10);
+		float v = y * y * y * (y * (y * 6 - 15) + 10);
+		float w = z * z * z * (z * (z * 6 - 15) + 10);
+
+		float g1 = grad_f(h[0 * BATCH + i], x, y, z);
+		float g2 = grad_f(h[1 * BATCH + i], x - 1, y, z);
+		float g3 = grad_f(h[2 * BATCH + i], x, y - 1, z);
+		float g4 = grad_f(h[3 * BATCH + i], x - 1, y - 1, z);
+		float g5 = grad_f(h[4 * BATCH + i], x, y, z - 1);
+		float g6 = grad_f(h[5 * BATCH + i], x - 1, y, z - 1);
+		float g7 = grad_f(h[6 * BATCH + i], x, y - 1, z - 1);
+		float g8 = grad_f(h[7 * BATCH + i], x - 1, y - 1, z - 1);
+
+		float l21 = lerp_f(v, lerp_f(u, g1, g2), lerp_f(u, g3, g4));
+		float l22 = lerp_f(v, lerp_f(u, g5, g6), lerp_f(u, g7, g8));
+
+		out[i] = (lerp_f(w, l21, l22) + 1.0f) * 0.5f;
+	}
+}
+
 /* 
 	permutation vector will be random 
 	shuffle algorithm: https://github.com/sol-prog/Perlin_Noise/blob/master/PerlinNoise.cpp
 */
 PerlinNoise::PerlinNoise(int seed)
 {
-	perm_vec.resize(256);
+	vector<int> perm_vec(256);
 
 	iota(perm_vec.begin(), perm_vec.end(), 0);
 
@@ -20,7 +70,8 @@ PerlinNoise::PerlinNoise(int seed)
 
 	shuffle(perm_vec.begin(), perm_vec.end(), e);
 
-	perm_vec.insert(perm_vec.end(), perm_vec.begin(), perm_vec.end());
+	for (int i = 0; i < 512; i++)
+		perm[i] = perm_vec[i & 255];
 }
 
 /*
@@ -42,21 +93,21 @@ double PerlinNoise::gen(double x, double y, double z)
 	double v = fade(y);
 	double w = fade(z);
 
-	int A = perm_vec[X] + Y;
-	int AA = perm_vec[A] + Z;
-	int AB = perm_vec[A + 1] + Z;
-	int B = perm_vec[X + 1] + Y;
-	int BA = perm_vec[B] + Z;
-	int BB = perm_vec[B + 1] + Z;
-
-	double g1 = grad(perm_vec[AA], x, y, z);
-	double g2 = grad(perm_vec[BA], x - 1, y, z);
-	double g3 = grad(perm_vec[AB], x, y - 1, z);
-	double g4 = grad(perm_vec[BB], x - 1, y - 1, z);
-	double g5 = grad(perm_vec[AA + 1], x, y, z - 1);
-	double g6 = grad(perm_vec[BA + 1], x - 1, y, z - 1);
-	double g7 = grad(perm_vec[AB + 1], x, y - 1, z - 1);
-	double g8 = grad(perm_vec[BB + 1], x - 1, y - 1, z - 1);
+	int A = perm[X] + Y;
+	int AA = perm[A] + Z;
+	int AB = perm[A + 1] + Z;
+	int B = perm[X + 1] + Y;
+	int BA = perm[B] + Z;
+	int BB = perm[B + 1] + Z;
+
+	double g1 = grad(perm[AA], x, y, z);
+	double g2 = grad(perm[BA], x - 1, y, z);
+	double g3 = grad(perm[AB], x, y - 1, z);
+	double g4 = grad(perm[BB], x - 1, y - 1, z);
+	double g5 = grad(perm[AA + 1], x, y, z - 1);
+	double g6 = grad(perm[BA + 1], x - 1, y, z - 1);
+	double g7 = grad(perm[AB + 1], x, y - 1, z - 1);
+	double g8 = grad(perm[BB + 1], x - 1, y - 1, z - 1);
 
 	double l31 = lerp(u, g1, g2);
 	double l32 = lerp(u, g3, g4);
@@ -87,4 +138,100 @@ double PerlinNoise::grad(int hash, double x, double y, double z)
 	double u = h < 8 ? x : y;
 	double v = h < 4 ? y : ((h == 12 || h == 14) ? x : z);
 	return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
-}
\ No newline at end of file
+}
+
+void PerlinNoise::gen(const float* x, const float* y, const float* z, float* out, int n) const
+{
+	float fx[BATCH], fy[BATCH], fz[BATCH];
+	int h[8 * BATCH];
+
+	for (int start = 0; start < n; start += BATCH)
+	{
+		int m = min(BATCH, n - start);
+
+		/* lattice cell, position inside it and the corner hashes */
+		for (int i = 0; i < m; i++)
+		{
+			float flx = floor(x[start + i]);
+			float fly = floor(y[start + i]);
+			float flz = floor(z[start + i]);
+
+			int X = (int)flx & 255;
+			int Y = (int)fly & 255;
+			int Z = (int)flz & 255;
+
+			fx[i] = x[start + i] - flx;
+			fy[i] = y[start + i] - fly;
+			fz[i] = z[start + i] - flz;
+
+			int A = perm[X] + Y;
+			int AA = perm[A] + Z;
+			int AB = perm[A + 1] + Z;
+			int B = perm[X + 1] + Y;
+			int BA = perm[B] + Z;
+			int BB = perm[B + 1] + Z;
+
+			h[0 * BATCH + i] = perm[AA] & 15;
+			h[1 * BATCH + i] = perm[BA] & 15;
+			h[2 * BATCH + i] = perm[AB] & 15;
+			h[3 * BATCH + i] = perm[BB] & 15;
+			h[4 * BATCH + i] = perm[AA + 1] & 15;
+			h[5 * BATCH + i] = perm[BA + 1] & 15;
+			h[6 * BATCH + i] = perm[AB + 1] & 15;
+			h[7 * BATCH + i] = perm[BB + 1] & 15;
+		}
+
+		noise_kernel(fx, fy, fz, h, out + start, m);
+	}
+}
+
+void PerlinNoise::fbm(const float* x, const float* y, const float* z, float* out, int n,
+	int octaves, float lacunarity, float gain) const
+{
+	float sx[BATCH], sy[BATCH], sz[BATCH], noise[BATCH];
+
+	/* the total strength, the octaves are averaged with it so the sum stays in 0 to 1 */
+	float total = 0;
+	float amp = 1;
+	for (int o = 0; o < octaves; o++)
+	{
+		total += amp;
+		amp *= gain;
+	}
+
+	for (int start = 0; start < n; start += BATCH)
+	{
+		int m = min(BATCH, n - start);
+		float* dst = out + start;
+
+		for (int i = 0; i < m; i++) dst[i] = 0;
+
+		float freq = 1;
+		amp = 1;
+		for (int o = 0; o < octaves; o++)
+		{
+			for (int i = 0; i < m; i++)
+			{
+				sx[i] = x[start + i] * freq;
+				sy[i] = y[start + i] * freq;
+				sz[i] = z[start + i] * freq;
+			}
+
+			gen(sx, sy, sz, noise, m);
+
+			for (int i = 0; i < m; i++)
+				dst[i] += amp * noise[i];
+
+			freq *= lacunarity;
+			amp *= gain;
+		}
+
+		/* one octave comes out exactly the same as gen() */
+		if (total > 0)
+			for (int i = 0; i < m; i++)
+				dst[i] = dst[i] / total;
+		else
+			for (int i = 0; i < m; i++)
+				dst[i] = 0.5f;
+	}
+}
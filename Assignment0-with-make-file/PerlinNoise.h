@@ -6,6 +6,7 @@
 #include <numeric>
 #include <random>
 #include <algorithm>
+#include <cstdint>
 
 using namespace std;
 
@@ -15,11 +16,29 @@ public:
 	PerlinNoise(int seed);
 	double gen(double x, double y, double z);
 
+	/*
+		Same noise for n points at once, out[i] = gen(x[i], y[i], z[i])
+		Done in floats so it's close to the double version but not exact
+		Only reads the table, so several threads can call it at once
+	*/
+	void gen(const float* x, const float* y, const float* z, float* out, int n) const;
+
+	/*
+		Fractal noise, octaves of gen() added together
+		-> each octave is at lacunarity times the frequency
+			and gain times the strength of the one before
+		-> still comes out between 0 and 1, and one octave is just gen()
+	*/
+	void fbm(const float* x, const float* y, const float* z, float* out, int n,
+		int octaves, float lacunarity = 2.0f, float gain = 0.5f) const;
+
 private:
 	double fade(double t);
 	double lerp(double t, double a, double b);
 	double grad(int hash, double x, double y, double z);
-	vector<int> perm_vec;
+
+	/* doubled up so perm[i + 1] never needs wrapping */
+	uint8_t perm[512];
 };
 
 #endif
\ No newline at end of file
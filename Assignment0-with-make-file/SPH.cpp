@@ -1,6 +1,171 @@
 #include "SPH.h"
 
-SPH::SPH(int np, int ts, float w, float h, bool grav)
+/* smallest run of particles (or pressure image rows) worth giving to another thread */
+static const int MIN_PARTICLES_PER_CHUNK = 1024;
+static const int MIN_ROWS_PER_CHUNK = 64;
+
+/*
+	Velocity, gravity, wall collisions and the position step
+	 for particles [start, end)
+	Written as straight math on the float arrays with no branches
+	 in the loop so the compiler turns it into SIMD at -O3.
+	The arrays are function parameters so __restrict actually
+	 counts, otherwise gcc has to assume they overlap.
+	Gravity type is a template parameter for the same reason,
+	 a branch on it in the loop stops it from vectorizing.
+*/
+template <bool circle>
+static void integrate_kernel(
+	float* __restrict px, float* __restrict py,
+	float* __restrict ox, float* __restrict oy,
+	float* __restrict vx, float* __restrict vy,
+	int start, int end, float dt, float gx, float gy,
+	float cx, float cy, float w, float h)
+{
+	const float inv_dt = 1 / dt;
+
+	for (int i = start; i < end; i++)
+	{
+		float x = px[i];
+		float y = py[i];
+
+		float vel_x = (x - ox[i]) * inv_dt;
+		float vel_y = (y - oy[i]) * inv_dt;
+
+		if (circle)
+		{
+			/* 300 / dist long, pointing away from the center */
+			float dx = x - cx;
+			float dy = y - cy;
+			float dist = sqrt(dx * dx + dy * dy);
+			float s = (300 / dist) / dist;
+			s = (dist == 0) ? 1.0f : s;
+
+			vel_x += (dx * s) * dt;
+			vel_y += (dy * s) * dt;
+		}
+		else
+		{
+			vel_x += gx;
+			vel_y += gy;
+		}
+
+		/* 
+			wall collision handling
+			worked out for every particle and picked with ?:
+			 so there are no branches
+		*/
+		bool hit = y < 0;
+		y = hit ? 0.0f : y;
+		vel_y = hit ? vel_y * -0.3f : vel_y;
+
+		hit = y > h;
+		y = hit ? h : y;
+		vel_y = hit ? vel_y * -0.3f : vel_y;
+
+		hit = x < 0;
+		x = hit ? 0.0f : x;
+		vel_x = hit ? vel_x * -0.5f : vel_x;
+
+		hit = x > w;
+		x = hit ? w : x;
+		vel_x = hit ? vel_x * -0.5f : vel_x;
+
+		ox[i] = x;
+		oy[i] = y;
+		vx[i] = vel_x;
+		vy[i] = vel_y;
+		px[i] = x + vel_x * dt;
+		py[i] = y + vel_y * dt;
+	}
+}
+
+/*
+	Density of particles [start, end) from their neighbors' q
+	Each particle's sum is split over 4 lanes (k % 4) that get
+	 added up in a fixed order at the end, so it runs 4 wide and
+	 still comes out exactly the same every run
+*/
+static void density_kernel(
+	const float* __restrict q,
+	const int* __restrict nbr_start, const int* __restrict nbr_end,
+	float* __restrict dens, float* __restrict densN, int start, int end)
+{
+	for (int i = start; i < end; i++)
+	{
+		float d[4] = {0, 0, 0, 0};
+		float dN[4] = {0, 0, 0, 0};
+
+		int k = nbr_start[i];
+		int last = nbr_end[i];
+
+		for (; k + 4 <= last; k += 4)
+		{
+			for (int l = 0; l < 4; l++)
+			{
+				float q2 = q[k + l] * q[k + l];
+				d[l] += q2;
+				dN[l] += q2 * q[k + l];
+			}
+		}
+
+		for (int l = 0; k < last; k++, l++)
+		{
+			float q2 = q[k] * q[k];
+			d[l] += q2;
+			dN[l] += q2 * q[k];
+		}
+
+		dens[i] = (d[0] + d[1]) + (d[2] + d[3]);
+		densN[i] = (dN[0] + dN[1]) + (dN[2] + dN[3]);
+	}
+}
+
+static void pressure_kernel(
+	const float* __restrict dens, const float* __restrict densN,
+	float* __restrict press, float* __restrict pressN,
+	int start, int end, float ks, float krd, float ksN)
+{
+	for (int i = start; i < end; i++)
+	{
+		float p = ks * (dens[i] - krd);
+		float pN = ksN * densN[i];
+
+		press[i] = (p > 30) ? 30.0f : p;
+		pressN[i] = (pN > 300) ? 300.0f : pN;
+	}
+}
+
+/*
+	One 1d pass of the blur, dst[j] = sum of w[k] * src[j + k]
+	src has to be taps - 1 longer than n, the caller pads it
+	k is on the outside so the inner loop is a plain
+	 multiply add over the row and vectorizes
+*/
+static void blur_kernel(
+	const float* __restrict src, const float* __restrict w,
+	float* __restrict dst, int n, int taps)
+{
+	for (int j = 0; j < n; j++) dst[j] = 0;
+
+	for (int k = 0; k < taps; k++)
+	{
+		float wk = w[k];
+		const float* s = src + k;
+		for (int j = 0; j < n; j++)
+			dst[j] += wk * s[j];
+	}
+}
+
+/* dst += w * src, the column pass of the blur is a run of these */
+static void add_scaled_kernel(
+	const float* __restrict src, float w, float* __restrict dst, int n)
+{
+	for (int j = 0; j < n; j++)
+		dst[j] += w * src[j];
+}
+
+SPH::SPH(int np, int ts, float w, float h, bool grav, ThreadPool& pool_) : pool(pool_)
 {
 	/* set values of sim */
 	this->grav_circle = grav;
@@ -27,27 +192,22 @@ SPH::SPH(int np, int ts, float w, float h, bool grav)
 	this->width = w;
 	this->height = h;
 
-	/* initialize press and dens records */
-	this->pressure_records.resize(ts * w * h);
-	this->density_records.resize(ts * w * h);
-
-	/* fun times */
-	/*for (int i = 0; i < ts; i++) 
-	{
-		for (int j = 0; j < h; j++)
-		{
-			for (int k = 0; k < w; k++)
-			{
-				cout << index(i, j, k) << endl;
-				this->pressure_records[index(i, j, k)];
-			}
-		}
-	}*/
-
-	/* particle vectors for position and velocity */
-	this->opos.resize(num_particles);
-	this->ppos.resize(num_particles);
-	this->pvel.resize(num_particles);
+	/* 
+		pressure sum per pixel, added to every timestep
+		pressure_step remembers which step last wrote a pixel
+	*/
+	this->pressure_sum.resize(w * h);
+	this->pressure_step.resize(w * h, -1);
+
+	/* particle arrays for position and velocity */
+	this->px.resize(num_particles);
+	this->py.resize(num_particles);
+	this->ox.resize(num_particles);
+	this->oy.resize(num_particles);
+	this->vx.resize(num_particles);
+	this->vy.resize(num_particles);
+	this->nx.resize(num_particles);
+	this->ny.resize(num_particles);
 
 	/* density vectors */
 	this->dens.resize(num_particles);
@@ -56,195 +216,455 @@ SPH::SPH(int np, int ts, float w, float h, bool grav)
 	/* pressure vectors */
 	this->press.resize(num_particles);
 	this->pressN.resize(num_particles);
+
+	/* 
+		neighbor search
+		- one bucket per cell inside the scene, in rows
+		- then at least twice as many buckets as particles for
+		   hashing cells outside the scene into, a power of 2
+		   so bucket() can mask instead of divide
+	*/
+	this->grid_w = (int)(w / this->ksr) + 1;
+	this->grid_h = (int)(h / this->ksr) + 1;
+
+	this->num_hashed = 1;
+	while (this->num_hashed < 2 * num_particles) this->num_hashed *= 2;
+	this->num_buckets = grid_w * grid_h + num_hashed;
+
+	this->cell_x.resize(num_particles);
+	this->cell_y.resize(num_particles);
+	this->bucket_of.resize(num_particles);
+	this->bucket_particles.resize(num_particles);
+	this->bucket_x.resize(num_particles);
+	this->bucket_y.resize(num_particles);
+	this->bucket_start.resize(num_buckets + 1);
+
+	/* 
+		threads, never more than there are particles
+		each one gets its own neighbor list and scratch
+	*/
+	this->num_threads = max(1, min(this->pool.size(), num_particles));
+
+	this->nbr_start.resize(num_particles);
+	this->nbr_end.resize(num_particles);
+	this->chunk_j.resize(num_threads);
+	this->chunk_q.resize(num_threads);
 }
 
 SPH::~SPH(){}
 
 void SPH::run()
 {
-	/* step 1: generate particles in a ball in center towards top */
-	float starting_circle_rad = 20;
-	vec2 center(this->width / 2, 20);
-
-	for (int i = 0; i < num_particles; i++)
+	/* 
+		step 1: generate particles in a ball in center towards top
+		- the ball grows with the particle count so bigger sims
+		   don't start out crushed together
+		- but it has to stay inside the scene, anything spawned
+		   outside gets squashed onto the walls in one spot and
+		   those particles never come apart again
+		- skipped when carrying on from a snapshot
+	*/
+	if (!this->resumed)
 	{
-		vec2 v;
-		float rand_r = arbitraryRand(0, starting_circle_rad);
-		v.x = arbitraryRand(-1, 1);
-		v.y = arbitraryRand(-1, 1);
-		v.setToLength(rand_r);
+		float starting_circle_rad = 20;
+		if (num_particles > 500)
+			starting_circle_rad *= sqrt(num_particles / 500.0);
+		starting_circle_rad = min(starting_circle_rad, min(this->width, this->height) / 2);
+		vec2 center(this->width / 2, max(20.0f, starting_circle_rad));
+
+		/* particle i always lands in the same spot, even if this loop gets split up */
+		for (int i = 0; i < num_particles; i++)
+		{
+			Rng rng(this->spawn_seed, i);
+
+			vec2 v;
+			float rand_r = rng.next(0, starting_circle_rad);
+			v.x = rng.next(-1, 1);
+			v.y = rng.next(-1, 1);
+			v.setToLength(rand_r);
 
-		this->ppos[i] = center.clone();
-		this->ppos[i].add(v);
+			this->px[i] = center.x + v.x;
+			this->py[i] = center.y + v.y;
 
-		this->opos[i] = this->ppos[i].clone();
+			this->ox[i] = this->px[i];
+			this->oy[i] = this->py[i];
+		}
 	}
 
 	/* step 2: update in a loop */
 
-	for (int i = 0; i < this->num_timesteps; i++)
+	for (int i = this->start_step; i < this->num_timesteps; i++)
 	{
 		update(this->dt, i);
+
+		if (this->checkpoint_every > 0 && (i + 1) % this->checkpoint_every == 0 && i + 1 < this->num_timesteps)
+			save_snapshot(this->checkpoint_prefix + "_" + to_string(i + 1) + ".sph", i + 1);
 	}
+
+	if (this->checkpoint_every > 0)
+		save_snapshot(this->checkpoint_prefix + "_" + to_string(this->num_timesteps) + ".sph", this->num_timesteps);
+}
+
+void SPH::set_checkpoints(string prefix, int every)
+{
+	this->checkpoint_prefix = prefix;
+	this->checkpoint_every = every;
+}
+
+void SPH::set_spawn_seed(uint32_t seed)
+{
+	this->spawn_seed = seed;
+}
+
+/*
+	Snapshot layout, native byte order, no padding:
+		"SPH1"
+		int32 num_particles, width, height, circle gravity, step
+		float px[n], py[n], ox[n], oy[n]
+		float pressure_sum[width*height]
+	the velocities aren't stored since update() works them out
+	 from the current and old positions anyway
+*/
+bool SPH::save_snapshot(string filename, int step)
+{
+	ofstream out(filename, ios::binary);
+	if (!out) return false;
+
+	int32_t header[5] = { num_particles, (int32_t)width, (int32_t)height, grav_circle ? 1 : 0, step };
+	out.write("SPH1", 4);
+	out.write((char*)header, sizeof(header));
+
+	for (vector<float>* v : { &px, &py, &ox, &oy, &pressure_sum })
+		out.write((char*)v->data(), v->size() * sizeof(float));
+
+	return (bool)out;
+}
+
+bool SPH::load_snapshot(string filename)
+{
+	ifstream in(filename, ios::binary);
+	if (!in) return false;
+
+	char magic[4];
+	int32_t header[5];
+	in.read(magic, 4);
+	in.read((char*)header, sizeof(header));
+	if (!in || string(magic, 4) != "SPH1") return false;
+
+	if (header[0] != num_particles || header[1] != (int32_t)width || header[2] != (int32_t)height
+		|| header[3] != (grav_circle ? 1 : 0) || header[4] < 0)
+		return false;
+
+	for (vector<float>* v : { &px, &py, &ox, &oy, &pressure_sum })
+		in.read((char*)v->data(), v->size() * sizeof(float));
+	if (!in) return false;
+
+	/* only matters within a step, nothing carries over */
+	fill(pressure_step.begin(), pressure_step.end(), -1);
+
+	this->start_step = header[4];
+	this->resumed = true;
+	return true;
 }
 
 /* 
 	Main update function
 	Goes through the SPH algorithm and updates positions and vels
-	Also records the densities and pressures at each timestep
+	Also adds the pressures of this timestep to pressure_sum
+
+	Everything is written per particle (gather) rather than per pair,
+	 so no two threads ever write to the same particle. Each
+	 particle adds up its neighbors in the same order every time, so
+	 the result doesn't depend on how many threads there are.
 */
 void SPH::update(float dt, int ts)
 {
-	vec2 dtGrav = gravity.clone();
-	dtGrav.multiplyScalar(dt);
+	/*
+		Applies gravity and current velocity to each of the particles.
+	*/
+	parallel_for(this->num_particles, MIN_PARTICLES_PER_CHUNK, [&](int, int start, int end)
+	{
+		integrate(start, end, dt);
+	});
+
+	find_neighbors();
 
-	vec2 center(this->width / 2, this->height / 2);
+	/* density and pressure, straight from each particle's neighbors */
+	parallel_for(this->num_particles, MIN_PARTICLES_PER_CHUNK, [&](int, int start, int end)
+	{
+		density_kernel(
+			this->nbr_q.data(),
+			this->nbr_start.data(), this->nbr_end.data(),
+			this->dens.data(), this->densN.data(), start, end
+		);
+		pressure_kernel(
+			this->dens.data(), this->densN.data(),
+			this->press.data(), this->pressN.data(), start, end,
+			this->ks, this->krd, this->ksN
+		);
+	});
 
 	/*
-		This loop applies gravity and current velocity to 
-		each of the particles. It also resets the density vectors.
+		Each pixel gets the pressure of one particle per timestep,
+		 the highest numbered particle on it wins (that's how the
+		 old per timestep records got overwritten).
+		Going backwards means the first one to reach a pixel
+		 is the one that counts.
+		Cheap enough that it stays on one thread.
 	*/
-	for (int i = 0; i < this->num_particles; i++)
+	for (int i = num_particles - 1; i >= 0; i--)
 	{
+		int x = (int)this->px[i];
+		int y = (int)this->py[i];
 
-		this->pvel[i] = this->ppos[i].clone();
-		this->pvel[i].sub(this->opos[i]);
+		if (x < 0) x = 0;
+		if (x >= this->width) x = this->width-1;
+		if (y < 0) y = 0;
+		if (y >= this->height) y = this->height-1;
 
-		this->pvel[i].multiplyScalar(1 / dt);
+		int p = ind(y, x);
+		if (this->pressure_step[p] == ts) continue;
 
-		if (!grav_circle)
-		{
-			this->pvel[i].add(dtGrav);
-		}
-		else 
+		this->pressure_step[p] = ts;
+		this->pressure_sum[p] += this->press[i];
+	}
+
+	/*
+		Pressure displacement
+		Every particle gets pushed away from each neighbor based on
+		 where everything was at the start of this loop, the new
+		 positions go into nx and ny and get swapped in after.
+		(It used to move particles one pair at a time, which can't
+		 be split up between threads.)
+	*/
+	parallel_for(this->num_particles, MIN_PARTICLES_PER_CHUNK, [&](int, int start, int end)
+	{
+		for (int i = start; i < end; i++)
 		{
-			vec2 newGrav = this->ppos[i].clone();
+			float x = this->px[i];
+			float y = this->py[i];
 
-			newGrav.sub(center);
+			for (int k = this->nbr_start[i]; k < this->nbr_end[i]; k++)
+			{
+				int j = this->nbr_j[k];
+				float q = this->nbr_q[k];
 
-			float dist = this->ppos[i].distanceTo(center);
+				float tp1 = (this->press[i] + this->press[j]) * q;
+				float tp2 = (this->pressN[i] + this->pressN[j]) * q * q;
+				float tp = tp1 + tp2; /* total pressure */
 
-			newGrav.setToLength(300/dist);
-			newGrav.multiplyScalar(dt);
-			this->pvel[i].add(newGrav);
-		}
+				float displacement = tp + (dt * dt);
 
-		/* wall collision handling */
-		if (this->ppos[i].y < 0)
-		{
-			this->ppos[i].y = 0;
-			this->pvel[i].y *= -0.3;
-		}
-		if (this->ppos[i].y > this->height)
-		{
-			this->ppos[i].y = this->height;
-			this->pvel[i].y *= -0.3;
-		}
-		if (this->ppos[i].x < 0)
-		{
-			this->ppos[i].x = 0;
-			this->pvel[i].x *= -0.5;
-		}
-		if (this->ppos[i].x > this->width)
-		{
-			this->ppos[i].x = this->width;
-			this->pvel[i].x *= -0.5;
-		}
+				x += (this->px[i] - this->px[j]) * displacement;
+				y += (this->py[i] - this->py[j]) * displacement;
+			}
 
-		this->opos[i] = this->ppos[i].clone();
-		vec2 vel = this->pvel[i].clone();
+			this->nx[i] = x;
+			this->ny[i] = y;
+		}
+	});
 
-		vel.multiplyScalar(dt);
+	this->px.swap(this->nx);
+	this->py.swap(this->ny);
+}
 
-		this->ppos[i].add(vel);
+void SPH::integrate(int start, int end, float dt)
+{
+	auto kernel = this->grav_circle ?
+		integrate_kernel<true> : integrate_kernel<false>;
+
+	kernel(
+		this->px.data(), this->py.data(),
+		this->ox.data(), this->oy.data(),
+		this->vx.data(), this->vy.data(),
+		start, end, dt,
+		this->gravity.x * dt, this->gravity.y * dt,
+		this->width / 2, this->height / 2,
+		this->width, this->height
+	);
+}
 
-		this->dens[i] = 0.0;
-		this->densN[i] = 0.0;
+/*
+	The chunks only depend on n, min_per_chunk and num_threads
+	A small sim (the default 500 particles) is a single chunk, handing
+	 a few microseconds of work to other threads costs more than it saves
+*/
+int SPH::parallel_for(int n, int min_per_chunk, function<void(int, int, int)> fn)
+{
+	int chunks = min(this->num_threads, n / max(min_per_chunk, 1));
+	if (chunks <= 1)
+	{
+		fn(0, 0, n);
+		return 1;
 	}
 
-	/* 
-		No BVH will be used for this pair search
-		This sim is not a large SPH sim thus,
-		 there is no particular reason to use something
-		 like a spatial grid.
-		If this was actually being rendered, maybe I would.
-	*/
-	vector<tuple<int, int, float>> pairs;
+	this->pool.run(chunks, [&](int t) {
+		int start = (int)((long long)n * t / chunks);
+		int end = (int)((long long)n * (t + 1) / chunks);
+		fn(t, start, end);
+	});
+
+	return chunks;
+}
+
+int SPH::bucket(int cx, int cy)
+{
+	if (cx >= 0 && cx < this->grid_w && cy >= 0 && cy < this->grid_h)
+		return cy * this->grid_w + cx;
+
+	unsigned int h = ((unsigned int)cx * 92837111u) ^ ((unsigned int)cy * 689287499u);
+	return this->grid_w * this->grid_h + (h & (this->num_hashed - 1));
+}
+
+/*
+	Counting sort of the particles into their buckets
+	Particles end up in increasing index order inside each bucket
+	Anything that went to inf or NaN can't be near anything
+	 so it is left out with a bucket of -1
+*/
+void SPH::build_cells()
+{
+	fill(this->bucket_start.begin(), this->bucket_start.end(), 0);
+
 	for (int i = 0; i < this->num_particles; i++)
 	{
-		for (int j = 0; j < this->num_particles; j++)
+		float cx = floor(this->px[i] / this->ksr);
+		float cy = floor(this->py[i] / this->ksr);
+
+		if (!isfinite(cx) || !isfinite(cy))
 		{
-			if (i < j)
-			{
-				float dist = this->ppos[i].distanceTo(this->ppos[j]);
-				if (dist < this->ksr)
-				{
-					float q = 1 - (dist / this->ksr);
-					pairs.push_back(tuple<int, int, float>{i, j, q});
-				}
-			}
+			this->bucket_of[i] = -1;
+			continue;
 		}
-	}
 
-	for (auto& pair : pairs)
-	{
-		float q = get<2>(pair);
-		float q2 = q * q;
-		float q3 = q * q * q; 
+		/* keeps the int cast defined, cells this far out just share */
+		cx = min(max(cx, -1e9f), 1e9f);
+		cy = min(max(cy, -1e9f), 1e9f);
 
-		this->dens[get<0>(pair)] += q2;
-		this->dens[get<1>(pair)] += q2;
-
-		this->densN[get<0>(pair)] += q3;
-		this->densN[get<1>(pair)] += q3;
+		this->cell_x[i] = (int)cx;
+		this->cell_y[i] = (int)cy;
+		this->bucket_of[i] = bucket(this->cell_x[i], this->cell_y[i]);
+		this->bucket_start[this->bucket_of[i] + 1]++;
 	}
 
-	for (int i = 0; i < num_particles; i++)
+	for (int b = 0; b < this->num_buckets; b++)
+		this->bucket_start[b + 1] += this->bucket_start[b];
+
+	/* bucket_start[b] is moved along as bucket b fills, then put back */
+	for (int i = 0; i < this->num_particles; i++)
 	{
-		this->press[i] = this->ks * (this->dens[i] - this->krd);
-		this->pressN[i] = ksN * this->densN[i];
+		if (this->bucket_of[i] == -1) continue;
 
-		if (this->press[i] > 30) this->press[i] = 30.0;
-		if (this->pressN[i] > 300) this->pressN[i] = 300.0;
+		int k = this->bucket_start[this->bucket_of[i]]++;
+		this->bucket_particles[k] = i;
+		this->bucket_x[k] = this->px[i];
+		this->bucket_y[k] = this->py[i];
 	}
 
-	for (int i = 0; i < num_particles; i++)
-	{
-		int x = (int)this->ppos[i].x;
-		int y = (int)this->ppos[i].y;
+	for (int b = this->num_buckets; b > 0; b--)
+		this->bucket_start[b] = this->bucket_start[b - 1];
+	this->bucket_start[0] = 0;
+}
 
-		if (x < 0) x = 0;
-		if (x >= this->width) x = this->width-1;
-		if (y < 0) y = 0;
-		if (y >= this->height) y = this->height-1;
+/*
+	Finds every neighbor closer than ksr for every particle
+	Particles are gone through in bucket order rather than by index,
+	 particles next to each other there look at the same few buckets
+	 so those stay in cache.
+	Each chunk fills its own lists, then the lists are put end to
+	 end so particle i's neighbors are nbr_j/nbr_q[nbr_start[i]]
+	 up to [nbr_end[i]]
+*/
+void SPH::find_neighbors()
+{
+	build_cells();
 
-		this->pressure_records[index(ts, y, x)] = this->press[i];
+	/* the inf/NaN ones aren't in any bucket and have no neighbors */
+	for (int i = 0; i < this->num_particles; i++)
+	{
+		if (this->bucket_of[i] != -1) continue;
+		this->nbr_start[i] = 0;
+		this->nbr_end[i] = 0;
 	}
 
-	for (auto& pair : pairs)
+	int num_sorted = this->bucket_start[this->num_buckets];
+
+	int chunks = parallel_for(num_sorted, MIN_PARTICLES_PER_CHUNK, [&](int chunk, int start, int end)
 	{
-		int i = get<0>(pair);
-		int j = get<1>(pair);
-		float q = get<2>(pair);
+		vector<int>& out_j = this->chunk_j[chunk];
+		vector<float>& out_q = this->chunk_q[chunk];
+		out_j.clear();
+		out_q.clear();
 
-		float tp1 = (this->press[i] + this->press[j]) * q;
-		float tp2 = (this->pressN[i] + this->pressN[j]) * q * q;
-		float tp = tp1 + tp2; /* total pressure */
+		for (int s = start; s < end; s++)
+		{
+			int i = this->bucket_particles[s];
+			float x = this->bucket_x[s];
+			float y = this->bucket_y[s];
+
+			/* offset inside this chunk for now */
+			this->nbr_start[i] = out_j.size();
+
+			int seen[9];
+			int num_seen = 0;
+
+			for (int cy = this->cell_y[i] - 1; cy <= this->cell_y[i] + 1; cy++)
+			{
+				for (int cx = this->cell_x[i] - 1; cx <= this->cell_x[i] + 1; cx++)
+				{
+					/* two of the 9 cells can share a bucket, only look once */
+					int b = bucket(cx, cy);
+					if (find(seen, seen + num_seen, b) != seen + num_seen) continue;
+					seen[num_seen++] = b;
+
+					for (int k = this->bucket_start[b]; k < this->bucket_start[b + 1]; k++)
+					{
+						float dx = this->bucket_x[k] - x;
+						float dy = this->bucket_y[k] - y;
+						float dist = sqrt(dx * dx + dy * dy);
+
+						int j = this->bucket_particles[k];
+						if (dist < this->ksr && j != i)
+						{
+							out_j.push_back(j);
+							out_q.push_back(1 - (dist / this->ksr));
+						}
+					}
+				}
+			}
 
-		float displacement = tp + (dt * dt);
+			this->nbr_end[i] = out_j.size();
+		}
+	});
 
-		vec2 vi = this->ppos[i].clone();
-		vec2 vj = this->ppos[j].clone();
+	/* where each chunk's list goes in the combined one */
+	vector<int> base(chunks + 1, 0);
+	for (int t = 0; t < chunks; t++)
+		base[t + 1] = base[t] + this->chunk_j[t].size();
 
-		vi.sub(this->ppos[j]);
-		vi.multiplyScalar(displacement);
+	this->nbr_j.resize(base[chunks]);
+	this->nbr_q.resize(base[chunks]);
 
-		vj.sub(this->ppos[i]);
-		vj.multiplyScalar(displacement);
+	parallel_for(num_sorted, MIN_PARTICLES_PER_CHUNK, [&](int chunk, int start, int end)
+	{
+		for (int s = start; s < end; s++)
+		{
+			int i = this->bucket_particles[s];
+			this->nbr_start[i] += base[chunk];
+			this->nbr_end[i] += base[chunk];
+		}
 
-		this->ppos[i].add(vi);
-		this->ppos[j].add(vj);
-	}
+		copy(
+			this->chunk_j[chunk].begin(),
+			this->chunk_j[chunk].end(),
+			this->nbr_j.begin() + base[chunk]
+		);
+		copy(
+			this->chunk_q[chunk].begin(),
+			this->chunk_q[chunk].end(),
+			this->nbr_q.begin() + base[chunk]
+		);
+	});
 }
 
 /* currently not used */
@@ -255,72 +675,71 @@ vector<float> SPH::calc_density()
 }
 
 
-vector<float> SPH::calc_pressure()
+/*
+	Pressure image: log of the summed pressure, then a gaussian blur
+	 to spread it out a bit so it doesn't look like a bunch of dots
+	-> done as a row pass then a column pass, each reads only from
+		the previous stage so every pixel comes out the same no matter
+		what order (or how many threads) it was done in
+	-> edges repeat the border pixel
+	-> log of an empty pixel is -inf, those and anything under 1
+		start out as 0, the image code clamps negatives to 0 anyway
+*/
+vector<float> SPH::calc_pressure(int radius)
 {
-	vector<float> ret(this->width * this->height);
-	for (int i = 0; i < this->height; i++)
+	int w = this->width;
+	int h = this->height;
+	vector<float> ret(w * h);
+
+	if (radius < 0) radius = 0;
+	int taps = 2 * radius + 1;
+
+	/* sigma of radius / 2 puts the cutoff at 2 standard deviations */
+	vector<float> weights(taps);
+	float sigma = max(radius / 2.0f, 0.5f);
+	float total = 0;
+	for (int k = 0; k < taps; k++)
 	{
+		float d = k - radius;
+		weights[k] = exp(-d * d / (2 * sigma * sigma));
+		total += weights[k];
+	}
+	for (auto& wk : weights) wk /= total;
 
-		for (int j = 0; j < this->width; j++)
+	vector<float> log_press(w * h);
+	vector<float> rows(w * h);
+
+	/* log and the row pass */
+	parallel_for(h, MIN_ROWS_PER_CHUNK, [&](int, int start, int end) {
+		vector<float> padded(w + 2 * radius);
+		for (int i = start; i < end; i++)
 		{
-			for (int k = 0; k < this->num_timesteps; k++)
+			for (int j = 0; j < w; j++)
 			{
-				ret[ind(i, j)] += this->pressure_records[index(k, i, j)];
+				float v = log(abs(this->pressure_sum[ind(i, j)]));
+				log_press[ind(i, j)] = (v > 0 && v < INFINITY) ? v : 0.0f;
 			}
 
-			ret[ind(i, j)] = log(abs(ret[ind(i, j)]));
-
-			/* this is gonna get really ugly */
-
-			/* one diffusion level */
-			if (i > 0) 
-				ret[ind(i - 1, j)] += ret[ind(i, j)] / 2;
-			if (j > 0) 
-				ret[ind(i, j - 1)] += ret[ind(i, j)] / 2;
-			if (i > 0 && j > 0) 
-				ret[ind(i, j - 1)] += ret[ind(i, j)] / 2;
-			if (i < height-1) 
-				ret[ind(i + 1, j)] += ret[ind(i, j)] / 2; 
-			if (j < width-1)
-				ret[ind(i, j + 1)] += ret[ind(i, j)] / 2;
-			if (i < height - 1 && j < width - 1)
-				ret[ind(i + 1, j + 1)] += ret[ind(i, j)] / 2;
-			if (i < height - 1 && j > 0)
-				ret[ind(i + 1, j - 1)] += ret[ind(i, j)] / 2;
-			if (i > 0 && j < width - 1)
-				ret[ind(i - 1, j + 1)] += ret[ind(i, j)] / 2;
-			
-			/* second diffusion level god I don't want to write this */
-			if (i > 1)
-				ret[ind(i - 2, j)] += ret[ind(i, j)] / 4;
-			if (j > 1)
-				ret[ind(i, j - 2)] += ret[ind(i, j)] / 4;
-
-			/*
-				I didn't finish this but I was gonna do the second ring
-				 fully and spread 1/4 of the original pressure to those pixels
-			*/
-			
-		}
-	}
+			for (int j = 0; j < w + 2 * radius; j++)
+				padded[j] = log_press[ind(i, min(max(j - radius, 0), w - 1))];
 
-	return ret;
-}
+			blur_kernel(padded.data(), weights.data(), &rows[ind(i, 0)], w, taps);
+		}
+	});
 
-/*
-	Gets the index based on timstep and desired pixel
-	This is like a 3d array smushed into a 2d
-*/
-int SPH::index(int ts, int pixel_h, int pixel_w)
-{	
-	int pt1 = (ts * (int)this->width * (int)this->height);
-	int pt2 = (pixel_h * (int)this->width) + pixel_w;
-	return pt1 + pt2;
-}
+	/* column pass, still split by rows, each output row is a weighted sum of whole input rows */
+	parallel_for(h, MIN_ROWS_PER_CHUNK, [&](int, int start, int end) {
+		for (int i = start; i < end; i++)
+		{
+			for (int k = 0; k < taps; k++)
+			{
+				int row = min(max(i + k - radius, 0), h - 1);
+				add_scaled_kernel(&rows[ind(row, 0)], weights[k], &ret[ind(i, 0)], w);
+			}
+		}
+	});
 
-int SPH::index(int ts, int ind)
-{
-	return (ts * (int)this->width * (int)this->height) + ind;
+	return ret;
 }
 
 int SPH::ind(int i, int j)
@@ -2,12 +2,18 @@
 #define SPH_H_
 
 #include <iostream>
+#include <fstream>
 #include <vector>
+#include <string>
+#include <cstdint>
 #include <random>
 #include <tuple>
+#include <thread>
+#include <functional>
 
 #include "vec2.h"
 #include "utils.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -18,7 +24,8 @@ using namespace std;
 class SPH
 {
 public:
-	SPH(int np, int ts, float w, float h, bool gravity);
+	/* the pool's size only changes the speed, the result is the same for any count */
+	SPH(int np, int ts, float w, float h, bool gravity, ThreadPool& pool);
 	~SPH();
 
 	/*
@@ -36,36 +43,103 @@ public:
 		These two functions take the float arrays and compress them into a single vector
 		That vector is then returned to the ppm_main to be turned into pixel values
 	*/
-	vector<float> calc_pressure();
+	/* radius of the blur in pixels, 0 is no blur */
+	vector<float> calc_pressure(int radius = 2);
 	vector<float> calc_density();
 
+	/*
+		Snapshots, so the image stuff can be messed with without
+		 rerunning the whole sim every time
+		-> a snapshot has the particles and the pressure sum so far,
+			see save_snapshot() for the layout
+		-> set_checkpoints makes run() write <prefix>_<step>.sph
+			every that many steps, and once more at the end
+		-> load_snapshot makes run() carry on from where the
+			snapshot was taken instead of starting over, a snapshot
+			from the last step means there's nothing left to run
+		-> load_snapshot returns false if the file can't be read or
+			was made with a different particle count / image size / gravity
+	*/
+	void set_checkpoints(string prefix, int every);
+
+	/* picks where the particles start out, the same seed always gives the same image */
+	void set_spawn_seed(uint32_t seed);
+	bool save_snapshot(string filename, int step);
+	bool load_snapshot(string filename);
+
 private:
 	/* used for getting index of vectors */
-	int index(int ts, int pixel_h, int pixel_w);
-	int index(int ts, int ind);
 	int ind(int i, int j);
 
 	/* main update function where SPH goes */
 	void update(float dt, int ts);
 
+	/* neighbor search, fills neighbors for the current positions */
+	int bucket(int cx, int cy);
+	void build_cells();
+	void find_neighbors();
+
+	/*
+		Splits [0, n) into contiguous chunks, no more than there are
+		 threads and none smaller than min_per_chunk, and runs
+		 fn(chunk, start, end) on each through the pool
+		Returns how many chunks there were
+	*/
+	int parallel_for(int n, int min_per_chunk, function<void(int, int, int)> fn);
+	void integrate(int start, int end, float dt);
+
 	/* 
 		What I actually want to record for the image gen 
-		Two 2d float arrays:
-		-> one holds pressure, the other holds density
-		-> first dimension is the current timestep
-		-> second dimension is the pixel values
-		-> access a specific index with the index() function
+		-> pressure_sum holds the pressure of every pixel
+			summed over all the timesteps so far
+		-> it is added to in update() so memory doesn't
+			grow with the number of timesteps
 		-> I think what I'll do is only record the absolute position
 			of the particle in the pixel and then in postprocessing
 			spread out the value to the surrounding pixels
 	*/
-	vector<float> pressure_records;
-	vector<float> density_records;
+	vector<float> pressure_sum;
+	vector<int> pressure_step;
 
-	/* helper functions go here */
-	vector<vec2> opos, ppos, pvel;
+	/* 
+		Particle state, one float array per component
+		-> p: position, o: old position, v: velocity
+		-> n: next position, the displacement pass writes it
+		-> x and y apart means the per particle loops are
+			straight runs over floats that vectorize
+	*/
+	vector<float> px, py, ox, oy, vx, vy, nx, ny;
 	vector<float> dens, densN, press, pressN;
 
+	/*
+		Cell grid + spatial hash for the pair search, rebuilt every step
+		-> cells are ksr wide so every neighbor of a particle
+			is somewhere in the 3x3 block of cells around it
+		-> cells in the scene are a plain grid, so cells next to
+			each other are next to each other in memory too
+		-> cells outside the scene get hashed into extra buckets
+			after the grid since plenty of particles fly way
+			outside of it, or off to inf
+		-> particles of bucket b are bucket_particles[bucket_start[b]]
+			up to bucket_particles[bucket_start[b + 1]]
+		-> bucket_x/y are their positions in the same order, so the
+			search reads them in a row instead of all over px/py
+		-> everything here keeps its memory between steps
+	*/
+	int grid_w, grid_h, num_hashed, num_buckets;
+	vector<int> cell_x, cell_y, bucket_of, bucket_start, bucket_particles;
+	vector<float> bucket_x, bucket_y;
+
+	/* every particle's neighbors and their q, see find_neighbors() */
+	vector<int> nbr_j, nbr_start, nbr_end;
+	vector<float> nbr_q;
+
+	/* per thread, kept between steps */
+	ThreadPool& pool;
+	int num_threads;
+	vector<vector<int>> chunk_j;
+	vector<vector<float>> chunk_q;
+
 	/* 
 		Two main art controlling vals
 		-> num_particles controlls how many will be visible
@@ -87,6 +161,15 @@ private:
 
 	/* scene bounds */
 	float width, height;
+
+	/* where the particles start out, see run() and set_spawn_seed() */
+	uint32_t spawn_seed = 0;
+
+	/* checkpoint settings and where run() starts */
+	string checkpoint_prefix;
+	int checkpoint_every = 0;
+	int start_step = 0;
+	bool resumed = false;
 };
 
 #endif
\ No newline at end of file
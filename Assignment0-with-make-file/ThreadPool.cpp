@@ -0,0 +1,83 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threads)
+{
+	this->num_threads = threads < 1 ? 1 : threads;
+	this->next_task = 0;
+
+	/* the caller of run() is the last thread */
+	for (int t = 1; t < this->num_threads; t++)
+		this->workers.push_back(thread(&ThreadPool::worker, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(this->mtx);
+		this->stopping = true;
+	}
+	this->start_cv.notify_all();
+
+	for (auto& t : this->workers) t.join();
+}
+
+void ThreadPool::run(int tasks, function<void(int)> fn)
+{
+	if (tasks <= 0) return;
+
+	/* nothing to share, don't wake anyone up */
+	if (tasks == 1 || this->workers.empty())
+	{
+		for (int task = 0; task < tasks; task++) fn(task);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(this->mtx);
+		this->job = &fn;
+		this->job_tasks = tasks;
+		this->next_task = 0;
+		this->workers_done = 0;
+		this->job_id++;
+	}
+	this->start_cv.notify_all();
+
+	work();
+
+	/* every worker has to check in, so none of them still holds fn */
+	unique_lock<mutex> lock(this->mtx);
+	this->done_cv.wait(lock, [this]{
+		return this->workers_done == (int)this->workers.size();
+	});
+	this->job = nullptr;
+}
+
+void ThreadPool::worker()
+{
+	int seen = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(this->mtx);
+			this->start_cv.wait(lock, [this, seen]{
+				return this->stopping || this->job_id != seen;
+			});
+			if (this->stopping) return;
+			seen = this->job_id;
+		}
+
+		work();
+
+		{
+			lock_guard<mutex> lock(this->mtx);
+			this->workers_done++;
+		}
+		this->done_cv.notify_one();
+	}
+}
+
+void ThreadPool::work()
+{
+	for (int task = this->next_task++; task < this->job_tasks; task = this->next_task++)
+		(*this->job)(task);
+}
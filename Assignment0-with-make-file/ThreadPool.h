@@ -0,0 +1,60 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+/*
+	One set of worker threads for the whole program
+	-> started once and then parked on a condition variable between
+		jobs, instead of creating and joining threads on every call
+		(the sim makes a handful of calls every step, that added up
+		 to more time than the actual work)
+	-> the thread calling run() does tasks too, so a pool of 1
+		is just a plain loop with no threads at all
+	-> only one run() at a time, fn can't call run() itself
+*/
+class ThreadPool
+{
+public:
+	ThreadPool(int threads);
+	~ThreadPool();
+
+	int size() { return this->num_threads; }
+
+	/*
+		Calls fn(task) once for every task in [0, tasks) and
+		 returns when they're all done.
+		Threads grab the next task as they go, so uneven tasks
+		 still keep every thread busy.
+	*/
+	void run(int tasks, function<void(int)> fn);
+
+private:
+	void worker();
+
+	/* grabs and runs tasks of the current job until there are none left */
+	void work();
+
+	int num_threads;
+	vector<thread> workers;
+
+	mutex mtx;
+	condition_variable start_cv, done_cv;
+	int job_id = 0;
+	int workers_done = 0;
+	bool stopping = false;
+
+	/* the current job */
+	function<void(int)>* job = nullptr;
+	int job_tasks = 0;
+	atomic<int> next_task;
+};
+
+#endif
@@ -15,7 +15,7 @@ Voronoi::Voronoi(int seed_, int num_nodes_, float w, float h,
 
 Voronoi::~Voronoi(){}
 
-vector<tuple<float, float, float>> Voronoi::gen()
+void Voronoi::gen(Framebuffer& fb)
 {
 	/* first generate random nodes */
 	default_random_engine e(this->seed);
@@ -29,7 +29,11 @@ vector<tuple<float, float, float>> Voronoi::gen()
 		Each region of pixels closest to this node will take on 
 		 that genned color.
 	*/
-	vector<pair<vec2, tuple<float, float, float>>> nodes;
+	this->node_x.resize(this->num_nodes);
+	this->node_y.resize(this->num_nodes);
+	this->node_r.resize(this->num_nodes);
+	this->node_g.resize(this->num_nodes);
+	this->node_b.resize(this->num_nodes);
 	for (int i = 0; i < this->num_nodes; i++)
 	{
 		float rand_width = w_uid(e);
@@ -47,93 +51,158 @@ vector<tuple<float, float, float>> Voronoi::gen()
 			this->cell_b = c_uid(e);
 		}
 
-		vec2 node(rand_width, rand_height);
-		tuple<float, float, float> t
-		{ 
-			this->cell_r, 
-			this->cell_g, 
-			this->cell_b 
-		};
-		nodes.push_back(pair<vec2, tuple<float, float, float>>{ node, t });
+		this->node_x[i] = rand_width;
+		this->node_y[i] = rand_height;
+		this->node_r[i] = this->cell_r;
+		this->node_g[i] = this->cell_g;
+		this->node_b[i] = this->cell_b;
 	}
 
+	build_grid();
+
 	/*
 		Next step is to go through all pixels and determine
 		 the closest node.
-		This will be slow as its a nearest neighbors search,
-		 and could be sped up by a BVH, but I'm lazy lol
-		There's also a lot of object copying being done 
-		 but that's because I didn't want to deal with memory management.
+		Used to check every node for every pixel, now the grid
+		 narrows it down to a handful, see gen_row()
+		Each row goes straight into the framebuffer, rows only
+		 write their own pixels so nothing has to be locked.
 	*/
-	vector<tuple<float, float, float>> pixels;
-	for (int i = 0; i < this->height; i++)
+	fb.for_rows([&](int row) {
+		gen_row(row, fb);
+	});
+}
+
+void Voronoi::build_grid()
+{
+	/* about two nodes per cell */
+	this->cell_size = sqrt(2 * (this->width + 1) * (this->height + 1) / this->num_nodes);
+	this->cell_size = max(this->cell_size, 1.0f);
+
+	this->grid_w = (int)(this->width / this->cell_size) + 1;
+	this->grid_h = (int)(this->height / this->cell_size) + 1;
+
+	/* counting sort, keeps each cell in node order */
+	vector<int> node_cell(this->num_nodes);
+	this->cell_start.assign(this->grid_w * this->grid_h + 1, 0);
+	for (int k = 0; k < this->num_nodes; k++)
 	{
-		for (int j = 0; j < this->width; j++)
+		int cx = min((int)(this->node_x[k] / this->cell_size), this->grid_w - 1);
+		int cy = min((int)(this->node_y[k] / this->cell_size), this->grid_h - 1);
+		node_cell[k] = cy * this->grid_w + cx;
+		this->cell_start[node_cell[k] + 1]++;
+	}
+
+	for (int c = 0; c < this->grid_w * this->grid_h; c++)
+		this->cell_start[c + 1] += this->cell_start[c];
+
+	vector<int> fill(this->cell_start.begin(), this->cell_start.end() - 1);
+	this->cell_nodes.resize(this->num_nodes);
+	for (int k = 0; k < this->num_nodes; k++)
+		this->cell_nodes[fill[node_cell[k]]++] = k;
+}
+
+/*
+	Closest node for every pixel of row i
+	Looks at rings of cells around the pixel's cell, one ring at a time.
+	Anything past ring r is at least r cells away, so once the best
+	 distance is under that no further ring can beat it.
+	Ties go to the lower node index, same as looping over all of them.
+*/
+void Voronoi::gen_row(int i, Framebuffer& fb)
+{
+	int w = this->width;
+	int max_ring = max(this->grid_w, this->grid_h);
+
+	int cy = min((int)(i / this->cell_size), this->grid_h - 1);
+
+	for (int j = 0; j < w; j++)
+	{
+		int cx = min((int)(j / this->cell_size), this->grid_w - 1);
+
+		float min_dist = 9e15;
+		int min_node_ind = -1;
+
+		for (int ring = 0; ring <= max_ring; ring++)
 		{
-			vec2 pixel(j, i);
-			float min_dist = 9e15;
-			int min_node_ind = -1;
-			for (int k = 0; k < this->num_nodes; k++)
+			/* a tiny margin so float rounding can't cut it short */
+			if (min_node_ind != -1 && min_dist * 1.0001f < (ring - 1) * this->cell_size)
+				break;
+
+			for (int dy = -ring; dy <= ring; dy++)
 			{
-				float dist = pixel.distanceTo(nodes[k].first);
-				if (dist < min_dist)
+				int y = cy + dy;
+				if (y < 0 || y >= this->grid_h) continue;
+
+				/* middle rows of the ring only have the two ends */
+				int step = (dy == -ring || dy == ring) ? 1 : 2 * ring;
+				for (int dx = -ring; dx <= ring; dx += step)
 				{
-					min_node_ind = k;
-					min_dist = dist;
+					int x = cx + dx;
+					if (x < 0 || x >= this->grid_w) continue;
+
+					int c = y * this->grid_w + x;
+					for (int n = this->cell_start[c]; n < this->cell_start[c + 1]; n++)
+					{
+						int k = this->cell_nodes[n];
+						float ddx = this->node_x[k] - j;
+						float ddy = this->node_y[k] - i;
+						float dist = sqrt(ddx * ddx + ddy * ddy);
+						if (dist < min_dist || (dist == min_dist && k < min_node_ind))
+						{
+							min_node_ind = k;
+							min_dist = dist;
+						}
+					}
 				}
 			}
-			if (min_node_ind == -1)
-			{
-				cerr << "Something went wrong in voronoi node solving." << endl;
-				exit(EXIT_FAILURE);
-			}
+		}
 
-			/* 
-				At this point, the min node has been found.
-				I want to make it so that the pixels closer to boundaries
-				 are a darker color than the pixels closer to the node.
-				This will make a nice gradient.
-				The closeness to a boundary can be determined by distance
-				 from the node. 
-				The further from the node, the closer to a boundary.
-			*/
-
-			/*
-				Okay so after some testing this method works pretty well,
-				 however, some splotches are very dark.
-				I figured this would happen I was just hoping I was wrong.
-				What I really need is to figure out the proportion of the 
-				 distance between the node and the edge which
-				 I'm not quite sure off the top of my head how to do.
-			*/
-
-			/*
-				Well after a bit more thinking, I can't come up with anything.
-				I'd love to  put more time into this but uh I think 
-				 I've gone overboard enough lol
-			*/
-			float r = get<0>(nodes[min_node_ind].second);
-			float g = get<1>(nodes[min_node_ind].second);
-			float b = get<2>(nodes[min_node_ind].second);
-
-			if (this->shaded)
-			{
-				r -= 5 * min_dist;
-				g -= min_dist;
-				b -= min_dist;
+		if (min_node_ind == -1)
+		{
+			cerr << "Something went wrong in voronoi node solving." << endl;
+			exit(EXIT_FAILURE);
+		}
 
-				if (r < 0) r = 0.0;
-				if (g < 0) g = 0.0;
-				if (b < 0) b = 0.0;
-			}
+		/* 
+			At this point, the min node has been found.
+			I want to make it so that the pixels closer to boundaries
+			 are a darker color than the pixels closer to the node.
+			This will make a nice gradient.
+			The closeness to a boundary can be determined by distance
+			 from the node. 
+			The further from the node, the closer to a boundary.
+		*/
+
+		/*
+			Okay so after some testing this method works pretty well,
+			 however, some splotches are very dark.
+			I figured this would happen I was just hoping I was wrong.
+			What I really need is to figure out the proportion of the 
+			 distance between the node and the edge which
+			 I'm not quite sure off the top of my head how to do.
+		*/
 
-			tuple<float, float, float> t(r, g, b);
+		/*
+			Well after a bit more thinking, I can't come up with anything.
+			I'd love to  put more time into this but uh I think 
+			 I've gone overboard enough lol
+		*/
+		float r = this->node_r[min_node_ind];
+		float g = this->node_g[min_node_ind];
+		float b = this->node_b[min_node_ind];
 
-			/*pixels.push_back(nodes[min_node_ind].second);*/
-			pixels.push_back(t);
+		if (this->shaded)
+		{
+			r -= 5 * min_dist;
+			g -= min_dist;
+			b -= min_dist;
+
+			if (r < 0) r = 0.0;
+			if (g < 0) g = 0.0;
+			if (b < 0) b = 0.0;
 		}
-	}
 
-	return pixels;
+		fb.put(i, j, r, g, b);
+	}
 }
-
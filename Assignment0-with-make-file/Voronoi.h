@@ -8,6 +8,7 @@
 
 #include "utils.h"
 #include "vec2.h"
+#include "Framebuffer.h"
 
 using namespace std;
 
@@ -18,11 +19,28 @@ public:
 		float r, float g, float b, bool type, bool rand_c);
 	~Voronoi();
 
-	vector<tuple<float, float, float>> gen();
+	/* fills fb (which has to be w by h), rows are spread over fb's thread pool */
+	void gen(Framebuffer& fb);
 private:
+	/*
+		Nodes are bucketed into a grid of square cells so each pixel
+		 only has to look at the cells around it
+		-> cell_start[c] .. cell_start[c + 1] indexes cell_nodes
+		-> cells hold node indices in increasing order
+	*/
+	void build_grid();
+	void gen_row(int i, Framebuffer& fb);
+
 	int seed, num_nodes;
 	float width, height, cell_r, cell_g, cell_b;
 	bool shaded, random_colors;
+
+	vector<float> node_x, node_y;
+	vector<float> node_r, node_g, node_b;
+
+	float cell_size;
+	int grid_w, grid_h;
+	vector<int> cell_start, cell_nodes;
 };
 
 #endif
@@ -5,11 +5,14 @@
 #include <string>
 #include <sstream>
 #include <tuple>
+#include <thread>
 
 #include "utils.h"
 #include "PerlinNoise.h"
 #include "SPH.h"
 #include "Voronoi.h"
+#include "Framebuffer.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -17,6 +20,40 @@ static int OUTPUT_WIDTH = 256;
 static int OUTPUT_HEIGHT = 256;
 static int NUM_COLORS = 255;
 
+/*
+	Size of the thread pool the SPH sim, voronoi and the framebuffer share,
+	 every core unless --threads says otherwise. The image doesn't change with this.
+*/
+static int NUM_THREADS = max(1, (int)thread::hardware_concurrency());
+
+/*
+	How far the SPH pressure gets smeared out, in pixels
+	Can be modified, 0 shows the raw particle tracks
+*/
+static int PRESSURE_BLUR = 2;
+
+/*
+	Octaves of noise in the perlin and combo images
+	Can be modified, each one adds finer detail on top
+	 (at half the strength of the one before)
+*/
+static int PERLIN_OCTAVES = 1;
+
+/*
+	SPH snapshots, set from the command line
+	-> CHECKPOINT_EVERY > 0 writes <input name>_<step>.sph that often
+	-> RESUME_FILE non empty starts the sim from that snapshot
+*/
+static int CHECKPOINT_EVERY = 0;
+static string CHECKPOINT_PREFIX;
+static string RESUME_FILE;
+
+/*
+	Where the SPH particles start out, set with --seed
+	Same seed, same image, 0 is what it's always been
+*/
+static uint32_t SPAWN_SEED = 0;
+
 static bool normal = false;
 static bool perlin = false;
 static bool particle = false;
@@ -24,24 +61,30 @@ static bool combo = false;
 static bool voronoi = false;
 
 /*
-	Helper function to put the rgb values to a ppm file
+	Runs the sim, taking the snapshot options into account
 */
-static void put(ofstream& outf, float r, float g, float b)
+static void run_sph(SPH& sim)
 {
-	outf <<
-		(int)r << " " <<
-		(int)g << " " <<
-		(int)b << "\n";
+	if (RESUME_FILE != "" && !sim.load_snapshot(RESUME_FILE))
+	{
+		cerr << "Could not resume from '" << RESUME_FILE << "'." << endl;
+		cerr << "It has to exist and match the particle count, image size and gravity." << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if (CHECKPOINT_EVERY > 0)
+		sim.set_checkpoints(CHECKPOINT_PREFIX, CHECKPOINT_EVERY);
+
+	sim.set_spawn_seed(SPAWN_SEED);
+	sim.run();
 }
 
 /*
 	Uses a voronoi diagram to make the ppm.
 */
-static void voronoi_ppm(ofstream& outf, int seed, int node_count,
+static void voronoi_ppm(Framebuffer& fb, int seed, int node_count,
 	float v_r, float v_g, float v_b, bool type, bool rand_c)
 {
-	outf << create_ppm_header("P3", OUTPUT_WIDTH, OUTPUT_HEIGHT, NUM_COLORS);
-
 	Voronoi v(
 		seed, 
 		node_count, 
@@ -51,17 +94,7 @@ static void voronoi_ppm(ofstream& outf, int seed, int node_count,
 		type,
 		rand_c
 	);
-	vector<tuple<float, float, float>> pixels = v.gen();
-
-	for (auto& p : pixels)
-	{
-		put(
-			outf, 
-			get<0>(p),
-			get<1>(p),
-			get<2>(p)
-		);
-	}
+	v.gen(fb);
 }
 
 /*
@@ -73,16 +106,14 @@ static void voronoi_ppm(ofstream& outf, int seed, int node_count,
 	 gravity is a circle rather than normal.
 
 */
-static void sph_perlin_combo(ofstream& outf, int seed, bool circle_grav)
+static void sph_perlin_combo(Framebuffer& fb, ThreadPool& pool, int seed, bool circle_grav, int num_particles)
 {
-	outf << create_ppm_header("P3", OUTPUT_WIDTH, OUTPUT_HEIGHT, NUM_COLORS);
-
 	PerlinNoise pns(seed);
 
-	SPH sim(500, 1000, OUTPUT_WIDTH, OUTPUT_HEIGHT, circle_grav);
-	sim.run();
+	SPH sim(num_particles, 1000, OUTPUT_WIDTH, OUTPUT_HEIGHT, circle_grav, pool);
+	run_sph(sim);
 
-	vector<float> press_vals = sim.calc_pressure();
+	vector<float> press_vals = sim.calc_pressure(PRESSURE_BLUR);
 	vector<float> dens_vals = sim.calc_density(); /* ignore this */
 
 	/* color scheme 1 */
@@ -98,48 +129,83 @@ static void sph_perlin_combo(ofstream& outf, int seed, bool circle_grav)
 	float oldRange = max - min;
 	float newRange = 255 - 0;
 
-	int count = 0;
-	for (auto& f : press_vals)
-	{
-		f = (((f - min) * newRange) / oldRange);		
+	/*
+		Noise only gets made for the pixels under the threshold,
+		 a row of them at a time, one batch per color channel
+	*/
 
-		/* 30 before */
-		/*
-			This threshold can be modified in order to 
-			 make more or less of the image be perlin noise
-		*/
-		if (f < 30)
+	/* frequency of each color channel's noise along x, y, z */
+	const float freq[3][3] = { { 6, 2, 4 }, { 4, 4, 2 }, { 2, 6, 6 } };
+
+	fb.for_rows([&](int row) {
+		vector<int> cols;
+		vector<float> xs[3], ys[3], zs[3], noise[3];
+		for (int c = 0; c < 3; c++)
 		{
-			int row = count / OUTPUT_WIDTH;
-			int col = count % OUTPUT_WIDTH;
+			xs[c].resize(OUTPUT_WIDTH);
+			ys[c].resize(OUTPUT_WIDTH);
+			zs[c].resize(OUTPUT_WIDTH);
+			noise[c].resize(OUTPUT_WIDTH);
+		}
 
-			double x = (double)col / (double)OUTPUT_WIDTH;
-			double y = (double)row / (double)OUTPUT_HEIGHT;
-			double z = (double)(row + col) / (double)(OUTPUT_WIDTH + OUTPUT_HEIGHT);
+		float* f_row = &press_vals[row * OUTPUT_WIDTH];
 
-			double val = pns.gen(10 * x, 10 * y, 0.8);
+		for (int col = 0; col < OUTPUT_WIDTH; col++)
+		{
+			f_row[col] = (((f_row[col] - min) * newRange) / oldRange);
 
-			double r_val = 10 * pns.gen(6 * x, 2 * y, 4 * z);
-			double g_val = 15 * pns.gen(4 * x, 4 * y, 2 * z);
-			double b_val = 30 * pns.gen(2 * x, 6 * y, 6 * z);
+			/* 30 before */
+			/*
+				This threshold can be modified in order to 
+				 make more or less of the image be perlin noise
+			*/
+			if (f_row[col] < 30) cols.push_back(col);
+		}
 
-			r_val = r_val - floor(r_val);
-			g_val = g_val - floor(g_val);
-			b_val = b_val - floor(b_val);
+		int n = cols.size();
+		for (int k = 0; k < n; k++)
+		{
+			double x = (double)cols[k] / (double)OUTPUT_WIDTH;
+			double y = (double)row / (double)OUTPUT_HEIGHT;
+			double z = (double)(row + cols[k]) / (double)(OUTPUT_WIDTH + OUTPUT_HEIGHT);
 
-			put(outf, floor(255 * r_val), floor(255 * g_val), floor(255 * b_val));
+			for (int c = 0; c < 3; c++)
+			{
+				xs[c][k] = freq[c][0] * x;
+				ys[c][k] = freq[c][1] * y;
+				zs[c][k] = freq[c][2] * z;
+			}
 		}
-		else
+		for (int c = 0; c < 3; c++)
+			pns.fbm(xs[c].data(), ys[c].data(), zs[c].data(), noise[c].data(), n, PERLIN_OCTAVES);
+
+		int k = 0;
+		for (int col = 0; col < OUTPUT_WIDTH; col++)
 		{
-			float r = (0.7 * 256) - f * 0.5;
-			float g = (0.6 * 256) - f * 0.4;
-			float b = (1.0 * 256) - f * 0.3;
+			float f = f_row[col];
+			if (k < n && cols[k] == col)
+			{
+				double r_val = 10 * noise[0][k];
+				double g_val = 15 * noise[1][k];
+				double b_val = 30 * noise[2][k];
+				k++;
+
+				r_val = r_val - floor(r_val);
+				g_val = g_val - floor(g_val);
+				b_val = b_val - floor(b_val);
+
+				fb.put(row, col, floor(255 * r_val), floor(255 * g_val), floor(255 * b_val));
+			}
+			else
+			{
+				float r = (0.7 * 256) - f * 0.5;
+				float g = (0.6 * 256) - f * 0.4;
+				float b = (1.0 * 256) - f * 0.3;
 
-			put(outf, 0, g, b);
-			
+				fb.put(row, col, 0, g, b);
+			}
 		}
-		count++;
-	}
+	});
 }
 
 /*
@@ -152,14 +218,12 @@ static void sph_perlin_combo(ofstream& outf, int seed, bool circle_grav)
 	The timesteps are combined and it is returned after which the values
 	 are converted into a range between 0 and 255 and the blue channel is used.
 */
-static void sph_based_ppm(ofstream& outf, bool circle_grav)
+static void sph_based_ppm(Framebuffer& fb, ThreadPool& pool, bool circle_grav, int num_particles)
 {
-	outf << create_ppm_header("P3", OUTPUT_WIDTH, OUTPUT_HEIGHT, NUM_COLORS);
-
-	SPH sim(500, 1000, OUTPUT_WIDTH, OUTPUT_HEIGHT, circle_grav);
-	sim.run();
+	SPH sim(num_particles, 1000, OUTPUT_WIDTH, OUTPUT_HEIGHT, circle_grav, pool);
+	run_sph(sim);
 
-	vector<float> press_vals = sim.calc_pressure();
+	vector<float> press_vals = sim.calc_pressure(PRESSURE_BLUR);
 	vector<float> dens_vals = sim.calc_density(); /* ignore this for now */
 
 	/* color scheme 1 */
@@ -179,16 +243,19 @@ static void sph_based_ppm(ofstream& outf, bool circle_grav)
 		The color scheme here can be changed a bit by modifying these values.
 	*/
 
-	for (auto& f : press_vals)
-	{
-		f = (((f - min) * newRange) / oldRange);
+	fb.for_rows([&](int row) {
+		for (int col = 0; col < OUTPUT_WIDTH; col++)
+		{
+			float f = press_vals[row * OUTPUT_WIDTH + col];
+			f = (((f - min) * newRange) / oldRange);
 
-		float r = (0.7 * 256) - f * 0.5;
-		float g = (0.6 * 256) - f * 0.4;
-		float b = (1.0 * 256) - f * 0.2;
+			float r = (0.7 * 256) - f * 0.5;
+			float g = (0.6 * 256) - f * 0.4;
+			float b = (1.0 * 256) - f * 0.2;
 
-		put(outf, 0, 0, f);
-	}
+			fb.put(row, col, 0, 0, f);
+		}
+	});
 
 	/* color scheme 2 */
 	/*for (auto& f : press_vals)
@@ -211,28 +278,31 @@ static void sph_based_ppm(ofstream& outf, bool circle_grav)
 	The lower they are, the more "wood" like and smooth
 	The higher they are, the more chaotic and disjointed
 */
-static void perlin_based_ppm(ofstream& outf, int seed)
+static void perlin_based_ppm(Framebuffer& fb, int seed)
 {
-	outf << create_ppm_header("P3", OUTPUT_WIDTH, OUTPUT_HEIGHT, NUM_COLORS);
-
 	PerlinNoise pns(seed);
-	for (int row = 0; row < OUTPUT_HEIGHT; row++)
-	{
+
+	/* noise is done a whole row at a time */
+	fb.for_rows([&](int row) {
+		vector<float> xs(OUTPUT_WIDTH), ys(OUTPUT_WIDTH), zs(OUTPUT_WIDTH), noise(OUTPUT_WIDTH);
+
 		for (int col = 0; col < OUTPUT_WIDTH; col++)
 		{
-			double x = (double)col / (double)OUTPUT_WIDTH;
-			double y = (double)row / (double)OUTPUT_HEIGHT;
-			double z = (double)(row + col) / (double)(OUTPUT_WIDTH + OUTPUT_HEIGHT);
-
-			double val = pns.gen(10*x, 10*y, 0.8);
+			xs[col] = (double)col / (double)OUTPUT_WIDTH;
+			ys[col] = (double)row / (double)OUTPUT_HEIGHT;
+			zs[col] = (double)(row + col) / (double)(OUTPUT_WIDTH + OUTPUT_HEIGHT);
+		}
+		pns.fbm(xs.data(), ys.data(), zs.data(), noise.data(), OUTPUT_WIDTH, PERLIN_OCTAVES);
 
+		for (int col = 0; col < OUTPUT_WIDTH; col++)
+		{
 			/*
 				Chaning the modifiers of the x, y, z 
 				 values or the gen'd value will change the look of the image
 			*/
-			double r_val = 20 * pns.gen(x, y, z);
-			double g_val = 15 * pns.gen(x, y, z);
-			double b_val = 10 * pns.gen(x, y, z);
+			double r_val = 20 * noise[col];
+			double g_val = 15 * noise[col];
+			double b_val = 10 * noise[col];
 
 			r_val = r_val - floor(r_val);
 			g_val = g_val - floor(g_val);
@@ -241,11 +311,10 @@ static void perlin_based_ppm(ofstream& outf, int seed)
 			/*
 				Changing this will change the color of the perlin image
 			*/
-			put(outf, floor(255 * r_val), floor(255 * g_val), floor(255 * b_val));
-			/*put(outf, floor(255 * r_val), floor(255 * g_val), floor(255 * b_val));*/
+			fb.put(row, col, floor(255 * r_val), floor(255 * g_val), floor(255 * b_val));
+			/*fb.put(row, col, floor(255 * r_val), floor(255 * g_val), floor(255 * b_val));*/
 		}
-	}
-
+	});
 }
 
 /* 
@@ -253,36 +322,78 @@ static void perlin_based_ppm(ofstream& outf, int seed)
 	This gradient has a magenta lower left and cyan upper right
 	Upper left is black and lower right is white
 */
-static void gradient_basic_ppm(ofstream& outf)
+static void gradient_basic_ppm(Framebuffer& fb)
 {
-	outf << create_ppm_header("P3", OUTPUT_WIDTH, OUTPUT_HEIGHT, NUM_COLORS);
-
-	for (int row = 0; row < OUTPUT_HEIGHT; row++) {
+	fb.for_rows([&](int row) {
 		for (int col = 0; col < OUTPUT_WIDTH; col++) {
-			put(outf,
+			fb.put(row, col,
 				row * (NUM_COLORS + 1.0) / OUTPUT_HEIGHT,
 				col * (NUM_COLORS + 1.0) / OUTPUT_WIDTH,
 				(row + col) * (NUM_COLORS + 1.0) / (OUTPUT_WIDTH + OUTPUT_HEIGHT)
 			);
 		}
-	}
+	});
 }
 
 int main(int argc, char** argv)
 {
 	/* 
 	 * arguments should be in this pattern:
-	 *		<executable> <input_file_name>.txt
-	 * any more or less arguments is error
+	 *		<executable> <input_file_name>.txt [options]
+	 * options only matter for the particle/combo images:
+	 *		--checkpoint <steps>	save a snapshot every <steps> steps
+	 *		--resume <file>.sph		carry on from a snapshot
+	 *		--seed <n>				where the particles start out (default: 0)
+	 * and for every image:
+	 *		--threads <n>			how many threads to use (default: every core)
 	 */
 
-	if (argc != 2)
+	const char* syntax = "Syntax: <executable> <input_file_name>.txt [--checkpoint <steps>] [--resume <file>.sph] [--seed <n>] [--threads <n>]";
+	if (argc < 2)
 	{
 		cerr << "Incorrect number of command line arguments." << endl;
-		cerr << "Syntax: <executable> <input_file_name>.txt" << endl;
+		cerr << syntax << endl;
 		exit(EXIT_FAILURE);
 	}
 
+	for (int i = 2; i < argc; i += 2)
+	{
+		string opt = argv[i];
+		if (i + 1 >= argc || (opt != "--checkpoint" && opt != "--resume" && opt != "--seed" && opt != "--threads"))
+		{
+			cerr << "Bad command line option '" << opt << "'." << endl;
+			cerr << syntax << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		string val = argv[i + 1];
+		if (opt == "--resume")
+		{
+			RESUME_FILE = val;
+			continue;
+		}
+
+		if (opt == "--seed")
+		{
+			if (val.empty() || val.size() > 9 || val.find_first_not_of("0123456789") != string::npos)
+			{
+				cerr << "Seed must be a positive integer or zero." << endl;
+				exit(EXIT_FAILURE);
+			}
+			SPAWN_SEED = (uint32_t)stoi(val);
+			continue;
+		}
+
+		if (val.empty() || val.size() > 9 || val.find_first_not_of("0123456789") != string::npos || stoi(val) <= 0)
+		{
+			cerr << (opt == "--threads" ? "Thread count" : "Checkpoint interval") << " must be a positive integer." << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		if (opt == "--threads") NUM_THREADS = stoi(val);
+		else CHECKPOINT_EVERY = stoi(val);
+	}
+
 	/* open input file and check for existence */
 	ifstream inf{ argv[1] };
 	if (!inf)
@@ -305,6 +416,7 @@ int main(int argc, char** argv)
 	bool shade_type, color_type;
 	float v_r, v_g, v_b;
 	bool circle_grav;
+	int num_particles = 500;
 	while (!inf.eof())
 	{
 		/* 
@@ -439,19 +551,26 @@ int main(int argc, char** argv)
 				Also comments here will be a bit sparse as its pretty straight forward
 			*/
 
-			if ((perlin || particle) && tokens.size() != 1)
+			if (perlin && tokens.size() != 1)
 			{
 				cerr << "Error: Invalid input." << endl;
-				cerr << "Syntax: ";
-				cerr << (particle ? "<grav_type: normal/circle>" : "<seed>") << endl;
+				cerr << "Syntax: <seed>" << endl;
 				inf.close();
 				exit(EXIT_FAILURE);
 			}
 
-			if (combo && tokens.size() != 2)
+			if (particle && tokens.size() != 1 && tokens.size() != 2)
 			{
 				cerr << "Error: Invalid input." << endl;
-				cerr << "Syntax: <seed> <grav_type: normal/circle>" << endl;
+				cerr << "Syntax: <grav_type: normal/circle> <particle_count (optional)>" << endl;
+				inf.close();
+				exit(EXIT_FAILURE);
+			}
+
+			if (combo && tokens.size() != 2 && tokens.size() != 3)
+			{
+				cerr << "Error: Invalid input." << endl;
+				cerr << "Syntax: <seed> <grav_type: normal/circle> <particle_count (optional)>" << endl;
 				inf.close();
 				exit(EXIT_FAILURE);
 			}
@@ -525,6 +644,29 @@ int main(int argc, char** argv)
 				}
 			}
 
+			/* optional particle count, last token for particle and combo */
+			if ((particle && tokens.size() == 2) || (combo && tokens.size() == 3))
+			{
+				string& count = tokens[tokens.size() - 1];
+				for (auto& c : count)
+				{
+					if (!isdigit(c))
+					{
+						cerr << "Error: Particle count must be a positive integer." << endl;
+						inf.close();
+						exit(EXIT_FAILURE);
+					}
+				}
+
+				num_particles = stoi(count);
+				if (num_particles < 1)
+				{
+					cerr << "Error: Particle count must be greater than 0" << endl;
+					inf.close();
+					exit(EXIT_FAILURE);
+				}
+			}
+
 			if (voronoi)
 			{
 				/* extract node count */
@@ -666,41 +808,48 @@ int main(int argc, char** argv)
 		exit(EXIT_FAILURE);
 	}
 
+	CHECKPOINT_PREFIX = in_file_tokens[0];
 	string out_file_name = in_file_tokens[0] + ".ppm";
-	ofstream outf{ out_file_name, ios_base::trunc };
+	ofstream outf{ out_file_name, ios_base::trunc | ios_base::binary };
 	if (!outf)
 	{
 		cerr << "Error in creating '" << out_file_name << "' output file." << endl;
 		exit(EXIT_FAILURE);
 	}
 
+	/* started once, every generator below shares it */
+	ThreadPool pool(NUM_THREADS);
+
+	/* every type fills this in, then it gets written all at once at the end */
+	Framebuffer fb(OUTPUT_WIDTH, OUTPUT_HEIGHT, pool);
+
 	/* I feel like the rest of this is pretty self evident */
 
 	if (normal)
 	{
 		cout << "Generating Boring Image..." << endl;
-		gradient_basic_ppm(outf);
+		gradient_basic_ppm(fb);
 		cout << "Enjoy your image :)" << endl;
 	}
 
 	if (perlin)
 	{
 		cout << "Commencing Perlin Noise Creation..." << endl;
-		perlin_based_ppm(outf, seed);
+		perlin_based_ppm(fb, seed);
 		cout << "Enjoy your image :)" << endl;
 	}
 
 	if (particle)
 	{
 		cout << "Particle system initializing..." << endl;
-		sph_based_ppm(outf, circle_grav);
+		sph_based_ppm(fb, pool, circle_grav, num_particles);
 		cout << "Enjoy your image :)" << endl;
 	}
 
 	if (combo)
 	{
 		cout << "Combo detected..." << endl;
-		sph_perlin_combo(outf, seed, circle_grav);
+		sph_perlin_combo(fb, pool, seed, circle_grav, num_particles);
 		cout << "Enjoy your image :)" << endl;
 	}
 
@@ -708,7 +857,7 @@ int main(int argc, char** argv)
 	{
 		cout << "Voronoi generation..." << endl;
 		voronoi_ppm(
-			outf,
+			fb,
 			seed, 
 			node_count, 
 			v_r,
@@ -720,5 +869,11 @@ int main(int argc, char** argv)
 		cout << "Enjoy your image :)" << endl;
 	}
 
+	if (!fb.write(outf))
+	{
+		cerr << "Error in writing '" << out_file_name << "'." << endl;
+		exit(EXIT_FAILURE);
+	}
+
 	outf.close();
 }
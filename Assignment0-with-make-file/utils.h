@@ -7,6 +7,8 @@
 #include <sstream>
 #include <random>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 
 /*
 	A utils file I made for another project some other time
@@ -16,9 +18,57 @@
 
 using namespace std;
 
-static float arbitraryRand(float low, float high)
+/*
+	Counter based random numbers.
+	Each number is a hash of (seed, stream, counter), so it doesn't
+	 depend on what was drawn before it, which thread asked or when.
+	Meant to be addressed by what it's for, like a particle index as
+	 the stream and which coordinate it is as the counter.
+	The hash is the pcg one from "Hash Functions for GPU Rendering"
+	 (Jarzynski and Olano, 2020).
+*/
+class Rng
+{
+public:
+	Rng(uint32_t s = 0, uint32_t st = 0) : seed(s), stream(st), counter(0) {}
+
+	static uint32_t hash(uint32_t v)
+	{
+		uint32_t state = v * 747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	static uint32_t at(uint32_t seed, uint32_t stream, uint32_t counter)
+	{
+		return hash(hash(hash(seed) ^ stream) ^ counter);
+	}
+
+	/* [low, high), top 24 bits so every value is exact in a float */
+	static float uniform(uint32_t seed, uint32_t stream, uint32_t counter, float low, float high)
+	{
+		float t = (at(seed, stream, counter) >> 8) * (1.0f / 16777216.0f);
+		return low + t * (high - low);
+	}
+
+	/* the next number in this stream */
+	float next(float low, float high) { return uniform(seed, stream, counter++, low, high); }
+
+	uint32_t seed, stream, counter;
+};
+
+/*
+	Each thread gets its own stream, no locking like rand()
+	-> streams are handed out in the order threads first call this,
+		so two threads never get the same numbers
+	-> only reproducible within one thread, use Rng with an index
+		when the order things run in isn't fixed
+*/
+inline float arbitraryRand(float low, float high)
 {
-	return (low + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (high - low))));
+	static atomic<uint32_t> next_stream(0);
+	static thread_local Rng rng(0, next_stream++);
+	return rng.next(low, high);
 }
 
 static string create_ppm_header(string type, int width, int height, int colors)
@@ -10,6 +10,9 @@
 #include <algorithm>
 #include <random>
 #include <stack>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
 
 #include "color.h"
 #include "material.h"
@@ -20,6 +23,15 @@
 #include "ray.h"
 #include "light.h"
 #include "triangle.h"
+#include "stats.h"
+
+/* what the optional per pixel cost image records */
+enum HeatmapMode
+{
+    HEATMAP_OFF,
+    HEATMAP_TIME,  /* microseconds spent on the pixel */
+    HEATMAP_TESTS  /* bvh box + primitive tests, needs RT_STATS */
+};
 
 class RayTracer 
 {
@@ -29,11 +41,30 @@ public:
         vector<Object*>* o, vector<Light*>* l, bool parallel, 
         bool cueing, float amin, float amax, float dmin, 
         float dmax, Color& cueingcolor, int threads);
+    ~RayTracer();
 
     void gen(vector<Color>& pixels);
 
+    /* 
+        Only rows [row_start, row_end) of the image, pixels holds
+         just those rows. Used for handing out tiles to other processes.
+    */
+    void gen_rows(vector<Color>& pixels, int row_start, int row_end);
+
+    /* 
+        Moves the camera between calls to gen(), everything else
+         (objects, lights, worker threads) stays as it is
+    */
+    void set_camera(vec3 e, vec3 v, vec3 u);
+
+    void enable_heatmap(HeatmapMode mode);
+    /* one value per pixel, same layout as pixels from gen() */
+    vector<float>& get_heatmap();
+
 private:
-    void split_work(int start, int end, vector<Color>& pixels, vec3 ro, vec3* sw);
+    void split_work(int start, int end, vector<Color>& pixels, vec3 ro, vec3* sw,
+        int thread_id);
+    void worker(int thread_id);
     void define_viewing_system();
     // Color trace_ray(Ray& r, int depth);
     // Color shade_ray(Ray& r, float t, Object* o, int depth);
@@ -45,7 +76,6 @@ private:
     void get_all_intersects_in_distance(
         Ray* r, vector<Object*>& fill, float dist, Object* other
     );
-    float arbitrary_random(float min, float max);
     float calc_atten(float c1, float c2, float c3, float d);
 
     /* variables input by user */
@@ -70,6 +100,30 @@ private:
     /* threading */
     int num_threads;
 
+    /* 
+        Workers are started by the first gen() and then wait for
+         the next frame instead of being created and joined
+         every time, which adds up when animating
+    */
+    vector<thread> pool;
+    mutex pool_mtx;
+    condition_variable frame_cv, done_cv;
+    int frame_id = 0;
+    int workers_done = 0;
+    bool stopping = false;
+
+    /* what the current frame's workers read */
+    vector<Color>* frame_pixels;
+    vec3 frame_ro, frame_sw;
+    int frame_row_start, frame_row_end;
+
+    /* per thread counters, only filled in when built with RT_STATS */
+    vector<RenderStats> thread_stats;
+
+    /* per pixel cost, every thread only writes its own rows */
+    HeatmapMode heatmap_mode = HEATMAP_OFF;
+    vector<float> heatmap;
+
     /* recursion */
     int max_depth = 10;
     float od3;
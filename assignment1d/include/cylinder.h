@@ -54,6 +54,8 @@ public:
 
     bool intersects(Ray& ray, bool shadow)
     {
+        STAT_INC(prim_tests);
+
         /* 
             Cylinder Equation:
                 ||point - center||^2 - [(point - center) dot dir]^2 = r^2
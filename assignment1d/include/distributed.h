@@ -0,0 +1,106 @@
+#ifndef DISTRIBUTED_H_
+#define DISTRIBUTED_H_
+
+#include <string>
+#include <vector>
+
+#include "scene.h"
+
+/*
+    Splitting one render over several processes (or machines).
+
+    The coordinator sends every worker the scene text, then hands
+     out tiles of rows. Workers trace them with their own thread
+     pool and stream the finished rows back as 8 bit rgb, which
+     the coordinator drops straight into the final image.
+
+    A tile that has been out for too long gets handed to another
+     idle worker as well, whichever answer comes back first wins.
+    A worker that disconnects has its tiles put back in the queue.
+
+    Wire format, all on one stream:
+        coordinator -> worker
+            scene <nbytes>\n<scene file contents>
+            tile <id> <row_start> <row_end>\n
+            quit\n
+        worker -> coordinator
+            ready <width> <height>\n
+            done <id> <row_start> <row_end> <nbytes>\n<rgb bytes>
+
+    Texture/bump paths in the scene are opened by the worker,
+     so remote machines need the same files at the same paths.
+*/
+
+/*
+    How coordinator and workers find each other. Everything
+     ends up as a plain stream file descriptor so the protocol
+     doesn't care which one is used.
+*/
+class Transport
+{
+public:
+    virtual ~Transport() {}
+
+    /* coordinator: workers that exist straight away (local pipes) */
+    virtual std::vector<int> initial_workers() { return std::vector<int>(); }
+
+    /* coordinator: fd to accept() new workers on, -1 if there is none */
+    virtual int listener() { return -1; }
+
+    /* worker: connect to the coordinator, -1 on failure */
+    virtual int connect_to() { return -1; }
+};
+
+/*
+    forks n worker processes, each talking over its own socketpair
+    meant for testing the protocol on one machine
+*/
+class PipeTransport : public Transport
+{
+public:
+    PipeTransport(int n) { count = n; }
+    std::vector<int> initial_workers();
+
+private:
+    int count;
+};
+
+class UnixTransport : public Transport
+{
+public:
+    UnixTransport(std::string p) { path = p; }
+    ~UnixTransport();
+    int listener();
+    int connect_to();
+
+private:
+    std::string path;
+    int listen_fd = -1;
+};
+
+class TcpTransport : public Transport
+{
+public:
+    TcpTransport(std::string h, int p) { host = h; port = p; }
+    int listener();
+    int connect_to();
+
+private:
+    std::string host;
+    int port;
+    int listen_fd = -1;
+};
+
+/*
+    unix:<path>, tcp:<port> (listen) or tcp:<host>:<port> (connect)
+    exits with a message on anything else
+*/
+Transport* make_transport(std::string endpoint);
+
+/* renders scene_file across the transport's workers, returns ms */
+double coordinate(std::string scene_file, Transport& transport, int tile_rows);
+
+/* serves tiles on an already connected fd until told to quit */
+void run_worker(int fd);
+
+#endif
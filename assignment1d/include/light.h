@@ -14,6 +14,9 @@ public:
     float c1, c2, c3;
     virtual ~Light(){}
     virtual vec3 compute_L(Ray& r) = 0;
+
+    /* used by animations to move the light between frames */
+    virtual void set_position(vec3 p) { this->position = p; }
 };
 
 class DirectionalLight : public Light 
@@ -33,6 +36,14 @@ public:
     { 
         return this->neg_dir;
     }
+
+    /* for a directional light the position is its direction */
+    void set_position(vec3 dir)
+    {
+        this->position = dir.normalized();
+        this->neg_dir = this->position;
+        this->neg_dir *= -1.0f;
+    }
 };
 
 class PointLight : public Light
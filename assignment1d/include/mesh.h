@@ -371,6 +371,9 @@ public:
             return min_found;
         }
 
+        /* both children get a box test */
+        STAT_ADD(bvh_nodes, 2);
+
         float tx1l = (box->l->min.x - ray.orig.x)*ray.dir_inv.x;
         float tx2l = (box->l->max.x - ray.orig.x)*ray.dir_inv.x;
 
@@ -496,6 +499,8 @@ public:
             return;
         }
 
+        STAT_ADD(bvh_nodes, 2);
+
         float tx1l = (box->l->min.x - ray.orig.x)*ray.dir_inv.x;
         float tx2l = (box->l->max.x - ray.orig.x)*ray.dir_inv.x;
 
@@ -569,6 +574,7 @@ public:
         tmin = max(tmin, min(tz1, tz2));
         tmax = min(tmax, max(tz1, tz2));
 
+        STAT_INC(bvh_nodes);
         if (tmax < max(0.0f, tmin)) return;
 
         shadow_traverse_bvh(bvh_head, ray);
@@ -602,6 +608,7 @@ public:
         tmin = max(tmin, min(tz1, tz2));
         tmax = min(tmax, max(tz1, tz2));
 
+        STAT_INC(bvh_nodes);
         if (tmax < max(0.0f, tmin) || ray.t < max(0.0f, tmin)) return false;
 
         bool ret = traverse_bvh(bvh_head, ray, shadow);
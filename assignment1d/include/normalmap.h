@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "vec3.h"
+#include "stats.h"
 
 class NormalMap
 {
@@ -26,6 +27,8 @@ public:
 
     vec3 get_normal_at(float u, float v)
     {
+        STAT_INC(tex_fetches);
+
         float x = u * wm1; 
         float y = v * hm1;
         
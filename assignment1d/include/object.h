@@ -14,6 +14,7 @@
 #include "color.h"
 #include "texture.h"
 #include "normalmap.h"
+#include "stats.h"
 
 /*
     Base class for object.
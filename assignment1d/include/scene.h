@@ -0,0 +1,196 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <deque>
+#include <set>
+#include <cstdint>
+
+#include "vec3.h"
+#include "color.h"
+#include "material.h"
+#include "object.h"
+#include "light.h"
+#include "texture.h"
+#include "normalmap.h"
+#include "RayTracer.h"
+
+using namespace std;
+
+/*
+    Scene loading is split in two halves so that a long running
+     process (the render server) can hold on to the expensive one.
+
+    SceneView: camera, lights and image settings.
+                Cheap to parse, reparsed for every render.
+    Geometry:  materials, objects and the mesh bvhs.
+                Cached on a hash of the lines that define it
+                plus the contents of any texture/bump files used.
+
+    Textures and bump maps are cached on their file contents,
+     so a changed scene that still uses the same harbor.ppm
+     doesn't have to decode it again. They stay only as long as
+     a cached geometry uses them, so they're bounded the same way.
+*/
+
+/* keyframed vector, linear between keys and held past the ends */
+struct KeyTrack
+{
+    vector<pair<int, vec3>> keys; /* sorted by frame */
+
+    void add(int frame, vec3 v)
+    {
+        auto it = keys.begin();
+        while (it != keys.end() && it->first < frame) it++;
+
+        if (it != keys.end() && it->first == frame) it->second = v;
+        else keys.insert(it, make_pair(frame, v));
+    }
+
+    bool empty() { return keys.empty(); }
+
+    vec3 at(int frame)
+    {
+        if (frame <= keys.front().first) return keys.front().second;
+        if (frame >= keys.back().first) return keys.back().second;
+
+        int i = 1;
+        while (keys[i].first < frame) i++;
+
+        float t = (float)(frame - keys[i-1].first) / 
+                  (float)(keys[i].first - keys[i-1].first);
+        return keys[i-1].second * (1.0f - t) + keys[i].second * t;
+    }
+};
+
+struct SceneView
+{
+    vec3 eye_pos, view_dir, up_dir;
+    Color bkgcolor;
+    float hfov, out_width, out_height;
+    float bkg_eta = 1;
+    bool parallel = false;
+
+    bool cueing = false;
+    float amax = -1;
+    float amin = -1;
+    float dmax = -1;
+    float dmin = -1;
+    Color cueingcolor;
+
+    int threads = -1;
+    HeatmapMode heatmap_mode = HEATMAP_OFF;
+
+    vector<Light*> lights;
+
+    /* animation, set by 'frames' and 'key' */
+    bool animated = false;
+    int first_frame = 0;
+    int last_frame = 0;
+    KeyTrack eye_track, view_track, up_track;
+    map<int, KeyTrack> light_tracks; /* index into lights */
+
+    SceneView() {}
+    SceneView(const SceneView&) = delete;
+    SceneView& operator=(const SceneView&) = delete;
+
+    ~SceneView()
+    {
+        for (auto& l : lights) delete l;
+    }
+};
+
+class Geometry
+{
+public:
+    vector<Material*> materials;
+    vector<Object*> objects;
+
+    Geometry() {}
+    Geometry(const Geometry&) = delete;
+    Geometry& operator=(const Geometry&) = delete;
+
+    ~Geometry()
+    {
+        for (auto& m : materials) delete m;
+        for (auto& o : objects) delete o;
+    }
+};
+
+class AssetCache
+{
+public:
+    ~AssetCache();
+
+    /* decoded once per distinct file contents */
+    Texture* texture(string filename);
+    NormalMap* normal_map(string filename);
+
+    /*
+        Returns the geometry for these scene lines, building it
+         only if nothing with the same key is cached.
+        Owned by the cache, stays valid until max_geometries
+         newer ones have been built.
+    */
+    Geometry* geometry(vector<string>& lines);
+
+    uint64_t file_hash(string filename);
+
+    int hits = 0;
+    int misses = 0;
+    int max_geometries = 4;
+
+    int texture_count() { return textures.size() + normals.size(); }
+    int geometry_count() { return geometries.size(); }
+
+private:
+    struct FileKey
+    {
+        long long size, mtime;
+        uint64_t hash;
+    };
+
+    map<string, FileKey> file_hashes;
+    map<uint64_t, Texture*> textures;
+    map<uint64_t, NormalMap*> normals;
+    map<uint64_t, Geometry*> geometries;
+    map<uint64_t, vector<uint64_t>> geometry_files; /* texture/bump file hashes each geometry uses */
+    deque<uint64_t> geometry_order;
+
+    /* frees every texture and bump map no cached geometry uses */
+    void drop_unused_textures();
+};
+
+uint64_t hash_bytes(const string& s, uint64_t h = 14695981039346656037ULL);
+
+/* every line of the scene file, including empty ones */
+vector<string> read_scene_lines(string filename);
+
+/*
+    exits with a message on malformed input, same as the old main()
+    (throws InputError instead while err_msg_throws() is set)
+*/
+void parse_view(vector<string>& lines, SceneView& view);
+Geometry* build_geometry(vector<string>& lines, AssetCache& cache);
+
+RayTracer* make_tracer(SceneView& view, Geometry* geo);
+
+/* moves the camera and lights of an animated scene to a frame */
+void apply_frame(SceneView& view, RayTracer* r, int frame);
+
+/* ./outputs/<input name><suffix>.ppm, creates outputs/ if needed */
+string output_name(string input_file, string suffix);
+void write_ppm(string filename, int width, int height, vector<Color>& pixels);
+
+/*
+    Parse, build (or reuse) and render one scene file.
+    Empty out_file means the usual ./outputs/<name>.ppm.
+    Animated scenes write <name>_0000.ppm, <name>_0001.ppm, ...
+    Returns the time spent rendering in ms.
+*/
+double render_scene_file(string scene_file, string out_file, AssetCache& cache);
+
+#endif
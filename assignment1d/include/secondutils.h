@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <atomic>
+#include <cstdint>
 
 class Utils {
 public:
@@ -13,4 +14,44 @@ public:
     }
 };
 
+/*
+    Counter based random numbers.
+    Each number is a hash of (seed, stream, counter), so it doesn't
+     depend on what was drawn before it, which thread asked or when.
+    Meant to be addressed by what it's for, like the pixel index as
+     the stream and the sample number as the counter.
+    The hash is the pcg one from "Hash Functions for GPU Rendering"
+     (Jarzynski and Olano, 2020).
+*/
+class Rng
+{
+public:
+    Rng(std::uint32_t s = 0, std::uint32_t st = 0) : seed(s), stream(st), counter(0) {}
+
+    static std::uint32_t hash(std::uint32_t v)
+    {
+        std::uint32_t state = v * 747796405u + 2891336453u;
+        std::uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    static std::uint32_t at(std::uint32_t seed, std::uint32_t stream, std::uint32_t counter)
+    {
+        return hash(hash(hash(seed) ^ stream) ^ counter);
+    }
+
+    /* [low, high), top 24 bits so every value is exact in a float */
+    static float uniform(std::uint32_t seed, std::uint32_t stream, std::uint32_t counter,
+        float low, float high)
+    {
+        float t = (at(seed, stream, counter) >> 8) * (1.0f / 16777216.0f);
+        return low + t * (high - low);
+    }
+
+    /* the next number in this stream */
+    float next(float low, float high) { return uniform(seed, stream, counter++, low, high); }
+
+    std::uint32_t seed, stream, counter;
+};
+
 #endif 
\ No newline at end of file
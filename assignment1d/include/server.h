@@ -0,0 +1,30 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <string>
+
+#include "scene.h"
+
+/*
+    Long running render mode.
+    Keeps one AssetCache alive between requests so parsed geometry,
+     mesh bvhs and decoded textures only get rebuilt when the
+     scene lines or files behind them actually change.
+
+    Protocol is one command per line, one reply line per command:
+        render <scene.txt> [output.ppm]  -> ok <output> <ms>ms <hit|built>
+        stats                            -> ok hits <n> misses <n> ...
+        quit                             -> ok bye
+    Anything else, or a scene that doesn't parse, gets 'error <why>'.
+*/
+
+/* 
+    reads commands from in_fd and replies on out_fd until quit or eof
+    returns true if the client asked to quit
+*/
+bool serve_stream(int in_fd, int out_fd, AssetCache& cache);
+
+/* same protocol over a unix domain socket, one client at a time */
+void serve_socket(std::string path, AssetCache& cache);
+
+#endif
@@ -46,6 +46,8 @@ public:
 
     bool intersects(Ray& ray, bool shadow)
     {
+        STAT_INC(prim_tests);
+
         /* float a = 1; /* ray is guaranteed to be normalized */
         /* direction dot (origin - center) */
         vec3 omc = ray.orig - this->center;
@@ -0,0 +1,166 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+
+/*
+    Counters for figuring out where a render spends its time.
+    Every thread gets its own RenderStats through Stats::local(),
+     so incrementing never needs a lock. RayTracer::gen merges the
+     per thread copies once the render is done and prints a report.
+
+    Everything here is opt-in: unless RT_STATS is defined
+     (make STATS=1) the macros expand to nothing and the
+     hot path is exactly what it was before.
+*/
+
+enum StatPhase
+{
+    PHASE_PARSE,
+    PHASE_BUILD,
+    PHASE_SETUP,
+    PHASE_TRACE,
+    PHASE_COUNT
+};
+
+struct RenderStats
+{
+    uint64_t camera_rays = 0;
+    uint64_t shadow_rays = 0;
+    uint64_t reflect_rays = 0;
+    uint64_t refract_rays = 0;
+
+    uint64_t bvh_nodes = 0;
+    uint64_t prim_tests = 0;
+    uint64_t tex_fetches = 0;
+
+    /* summed recursion depth of every traced ray, for the average */
+    uint64_t depth_sum = 0;
+    uint64_t depth_samples = 0;
+    int max_depth = 0;
+
+    double phase_ms[PHASE_COUNT] = {0};
+    /* slowest single thread in the trace phase, shows load imbalance */
+    double max_thread_ms = 0;
+
+    void reset()
+    {
+        *this = RenderStats();
+    }
+
+    void merge(const RenderStats& o)
+    {
+        camera_rays += o.camera_rays;
+        shadow_rays += o.shadow_rays;
+        reflect_rays += o.reflect_rays;
+        refract_rays += o.refract_rays;
+        bvh_nodes += o.bvh_nodes;
+        prim_tests += o.prim_tests;
+        tex_fetches += o.tex_fetches;
+        depth_sum += o.depth_sum;
+        depth_samples += o.depth_samples;
+        max_depth = (o.max_depth > max_depth) ? o.max_depth : max_depth;
+
+        for (int i = 0; i < PHASE_COUNT; i++)
+            phase_ms[i] += o.phase_ms[i];
+
+        if (o.phase_ms[PHASE_TRACE] > max_thread_ms)
+            max_thread_ms = o.phase_ms[PHASE_TRACE];
+    }
+
+    void report(std::ostream& s, int threads) const
+    {
+        uint64_t total_rays =
+            camera_rays + shadow_rays + reflect_rays + refract_rays;
+
+        double avg_depth = depth_samples ?
+            (double)depth_sum / (double)depth_samples : 0.0;
+
+        s << "---- render stats ----" << "\n"
+          << "rays total:     " << total_rays << "\n"
+          << "  camera:       " << camera_rays << "\n"
+          << "  shadow:       " << shadow_rays << "\n"
+          << "  reflect:      " << reflect_rays << "\n"
+          << "  refract:      " << refract_rays << "\n"
+          << "bvh nodes:      " << bvh_nodes << "\n"
+          << "prim tests:     " << prim_tests << "\n"
+          << "tex fetches:    " << tex_fetches << "\n"
+          << "avg depth:      " << std::fixed << std::setprecision(3)
+                                << avg_depth << "\n"
+          << "max depth:      " << max_depth << "\n"
+          << "parse:          " << phase_ms[PHASE_PARSE] << "ms\n"
+          << "build:          " << phase_ms[PHASE_BUILD] << "ms\n"
+          << "setup:          " << phase_ms[PHASE_SETUP] << "ms\n"
+          << "trace (sum):    " << phase_ms[PHASE_TRACE] << "ms over "
+                                << threads << " threads\n"
+          << "trace (max):    " << max_thread_ms << "ms\n"
+          << "----------------------" << std::endl;
+        s.unsetf(std::ios_base::floatfield);
+    }
+};
+
+class Stats {
+public:
+    /* function local so every translation unit shares the same one */
+    static RenderStats& local()
+    {
+        static thread_local RenderStats s;
+        return s;
+    }
+};
+
+/* adds the lifetime of the object to a phase of the current thread */
+class PhaseTimer
+{
+public:
+    PhaseTimer(StatPhase p)
+    {
+        phase = p;
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~PhaseTimer()
+    {
+        stop();
+    }
+
+    /* for phases that don't line up with a scope */
+    void stop()
+    {
+        if (stopped) return;
+        stopped = true;
+
+        std::chrono::duration<double, std::milli> d =
+            std::chrono::steady_clock::now() - start;
+        Stats::local().phase_ms[phase] += d.count();
+    }
+
+private:
+    StatPhase phase;
+    bool stopped = false;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef RT_STATS
+    #define STAT_INC(field) (Stats::local().field++)
+    #define STAT_ADD(field, n) (Stats::local().field += (n))
+    #define STAT_DEPTH(d) do { \
+            RenderStats& _s = Stats::local(); \
+            _s.depth_sum += (d); \
+            _s.depth_samples++; \
+            if ((d) > _s.max_depth) _s.max_depth = (d); \
+        } while (0)
+    #define STAT_PHASE(p) PhaseTimer _phase_timer_##p(p)
+    #define STAT_PHASE_STOP(p) _phase_timer_##p.stop()
+#else
+    #define STAT_INC(field) ((void)0)
+    #define STAT_ADD(field, n) ((void)0)
+    #define STAT_DEPTH(d) ((void)0)
+    #define STAT_PHASE(p) ((void)0)
+    #define STAT_PHASE_STOP(p) ((void)0)
+#endif
+
+#endif
@@ -6,6 +6,7 @@
 #include <cassert>
 
 #include "color.h"
+#include "stats.h"
 
 class Texture
 {
@@ -27,6 +28,8 @@ public:
 
     Color* get_color_at(float u, float v)
     {
+        STAT_INC(tex_fetches);
+
         float whole;
         u = std::modf(u, &whole); 
         v = std::modf(v, &whole);
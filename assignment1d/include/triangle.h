@@ -2,6 +2,7 @@
 #define TRIANGLE_H_
 
 #include "object.h"
+#include "utils.h"
 
 using namespace std;
 
@@ -50,8 +51,7 @@ public:
         } 
         else if (!all_null)
         {
-            cerr << "Missing a vertex normal." << endl;
-            exit(EXIT_FAILURE);
+            err_msg("Missing a vertex normal.\n");
         }
         
         all_null = (_v1t == nullptr && _v2t == nullptr && _v3t == nullptr);
@@ -79,8 +79,7 @@ public:
         } 
         else if (!all_null)
         {
-            cerr << "Missing a vertex texture coordinate." << endl;
-            exit(EXIT_FAILURE);
+            err_msg("Missing a vertex texture coordinate.\n");
         }
 
         mat = m;
@@ -99,6 +98,8 @@ public:
 
     bool intersects(Ray& ray, bool shadow)
     {
+        STAT_INC(prim_tests);
+
         /* 
             tn = (-Ax0 - By0 - Cz0 - D) 
             td = (Axd + Byd + Czd)
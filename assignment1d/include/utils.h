@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <fstream>
 #include <sstream>
 #include <random>
 #include <algorithm>
@@ -12,11 +13,13 @@
 #include <thread>
 #include <future>
 #include <mutex>
+#include <stdexcept>
 
 #include "vec3.h"
 #include "color.h"
 #include "texture.h"
 #include "normalmap.h"
+#include "secondutils.h"
 
 using namespace std;
 
@@ -103,7 +106,7 @@ static NormalMap* read_ppm_to_normal(string filename)
 
 static mutex mtx;
 
-void process_things(vector<string>& file_vec, vector<Color>* vals,
+static void process_things(vector<string>& file_vec, vector<Color>* vals,
 					int file_start, int file_end, int colors)
 {
 	for (int i = file_start; i < file_end; i++)
@@ -253,6 +256,32 @@ static void put_all_normalized(ofstream& outf, vector<Color>& pixels, int num_co
 	outf << s;
 }
 
+/*
+	Turns per pixel costs into a black -> red -> yellow -> white ramp
+	Scaled against the most expensive pixel so the image always
+	 uses the full range
+*/
+static void heat_to_colors(vector<float>& costs, vector<Color>& out)
+{
+	float max_cost = 0.0f;
+	for (auto& c : costs) max_cost = max(max_cost, c);
+	if (max_cost <= 0.0f) max_cost = 1.0f;
+
+	out.clear();
+	out.reserve(costs.size());
+	for (auto& c : costs)
+	{
+		float t = (c / max_cost) * 3.0f;
+		out.push_back(
+			Color(
+				min(t, 1.0f),
+				min(max(t - 1.0f, 0.0f), 1.0f),
+				min(max(t - 2.0f, 0.0f), 1.0f)
+			)
+		);
+	}
+}
+
 /*
 	Helper function to put the rgb values to a ppm file
 */
@@ -291,15 +320,42 @@ static bool is_number(string s, vector<char> valid_chars)
 	return true;
 }
 
+/*
+	What err_msg throws instead of exiting while err_msg_throws() is set.
+	The render server sets it so a bad scene gets an error reply
+	 instead of taking the whole process (and its cache) down.
+*/
+struct InputError : public runtime_error
+{
+	InputError(string msg) : runtime_error(msg) {}
+};
+
+inline bool& err_msg_throws()
+{
+	static bool throws = false;
+	return throws;
+}
+
 static void err_msg(string msg)
 {
+    if (err_msg_throws()) throw InputError(msg);
+
     cerr << msg;
     exit(EXIT_FAILURE);
 }
 
-static float arbitraryRand(float low, float high)
+/*
+	Each thread gets its own stream, no locking like rand()
+	Streams are handed out in the order threads first call this,
+	 so two threads never get the same numbers.
+	Only reproducible within one thread, use Rng with an index
+	 when the order things run in isn't fixed
+*/
+inline float arbitraryRand(float low, float high)
 {
-	return (low + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (high - low))));
+	static atomic<uint32_t> next_stream(0);
+	static thread_local Rng rng(0, next_stream++);
+	return rng.next(low, high);
 }
 
 static string create_ppm_header(string type, int width, int height, int colors)
@@ -5,6 +5,48 @@ RayTracer::RayTracer(vec3& e, vec3& v, vec3& u,
         vector<Object*>* o, vector<Light*>* l, bool parallel, 
         bool cueing, float amin, float amax, float dmin, 
         float dmax, Color& cueingcolor, int threads)
+{
+    this->set_camera(e, v, u);
+
+    this->hfov = hf * M_PI / 180;
+    this->p_width = w;
+    this->p_height = h;
+    this->bkgcolor = bk;
+    this->bkg_eta = bk_eta;
+    this->objs = o;
+    this->lights = l;
+    this->parallel = parallel;
+
+    this->aspect_ratio = w / h;
+
+    this->num_threads = threads;
+    if (threads == -1)
+        this->num_threads = 1;
+    
+    this->cueing = cueing;
+    this->amin = amin;
+    this->amax = amax;
+    this->dmin = dmin;
+    this->dmax = dmax;
+
+    if (cueing)
+        this->bkgcolor = cueingcolor;
+
+    this->od3 = 1/3;
+}
+
+RayTracer::~RayTracer()
+{
+    {
+        lock_guard<mutex> lock(this->pool_mtx);
+        this->stopping = true;
+    }
+    this->frame_cv.notify_all();
+
+    for (auto& t : this->pool) t.join();
+}
+
+void RayTracer::set_camera(vec3 e, vec3 v, vec3 u)
 {
     this->eye = e;
     this->view = v.normalized();
@@ -35,35 +77,14 @@ RayTracer::RayTracer(vec3& e, vec3& v, vec3& u,
         view.z += 9e-10;
         view.normalize();
     }
-
-    this->hfov = hf * M_PI / 180;
-    this->p_width = w;
-    this->p_height = h;
-    this->bkgcolor = bk;
-    this->bkg_eta = bk_eta;
-    this->objs = o;
-    this->lights = l;
-    this->parallel = parallel;
-
-    this->aspect_ratio = w / h;
-
-    this->num_threads = threads;
-    if (threads == -1)
-        this->num_threads = 1;
-    
-    this->cueing = cueing;
-    this->amin = amin;
-    this->amax = amax;
-    this->dmin = dmin;
-    this->dmax = dmax;
-
-    if (cueing)
-        this->bkgcolor = cueingcolor;
-
-    this->od3 = 1/3;
 }
 
 void RayTracer::gen(vector<Color>& pixels)
+{
+    this->gen_rows(pixels, 0, this->p_height);
+}
+
+void RayTracer::gen_rows(vector<Color>& pixels, int row_start, int row_end)
 {
     
     /* defines the viewing system for the RayCaster */
@@ -79,49 +100,116 @@ void RayTracer::gen(vector<Color>& pixels)
             ll:         lower left corner
             lr:         lower right corner
     */
-    this->define_viewing_system();
+    {
+        STAT_PHASE(PHASE_SETUP);
+        this->define_viewing_system();
+    }
     
     /* each ray corresponds 1-1 with the pixels vector */
+    int rows = row_end - row_start;
     pixels.clear();
-    pixels.resize(this->p_height * this->p_width);
+    pixels.resize(rows * this->p_width);
+
+    if (this->heatmap_mode != HEATMAP_OFF)
+        this->heatmap.assign(rows * this->p_width, 0.0f);
 
-    vec3 ray_orig = this->eye;
-    vec3 scaled_w = this->w.toLength(this->d);
     /* find center of each window pane and generate ray */
+    this->frame_pixels = &pixels;
+    this->frame_row_start = row_start;
+    this->frame_row_end = row_end;
+    this->frame_ro = this->eye;
+    this->frame_sw = this->w.toLength(this->d);
+
+#ifdef RT_STATS
+    this->thread_stats.assign(this->num_threads, RenderStats());
+#endif
+
+    /* thread creation, only happens on the first frame */
+    if (this->pool.empty())
+    {
+        for (int i = 0; i < this->num_threads; i++)
+            this->pool.push_back(thread(&RayTracer::worker, this, i));
+    }
 
-    int step = ceil(this->p_height / this->num_threads);
+    /* start the frame and wait for every worker to finish its rows */
+    unique_lock<mutex> lock(this->pool_mtx);
+    this->workers_done = 0;
+    this->frame_id++;
+    this->frame_cv.notify_all();
 
-    /* thread creation */
-    vector<thread> threads;
-    for (int i = 0; i < this->num_threads; i++)
+    this->done_cv.wait(lock, [this]{ 
+        return this->workers_done == this->num_threads; 
+    });
+    lock.unlock();
+
+#ifdef RT_STATS
+    /* 
+        main thread holds parse/build/setup times, 
+         workers hold everything else 
+    */
+    RenderStats total = Stats::local();
+    for (auto& s : this->thread_stats) total.merge(s);
+    total.report(cerr, this->num_threads);
+    Stats::local().reset();
+#endif
+}
+
+void RayTracer::enable_heatmap(HeatmapMode mode)
+{
+    this->heatmap_mode = mode;
+}
+
+vector<float>& RayTracer::get_heatmap()
+{
+    return this->heatmap;
+}
+
+void RayTracer::worker(int thread_id)
+{
+    int seen = 0;
+    while (true)
     {
-        threads.push_back(
-            thread(
-                &RayTracer::split_work, 
-                this, 
-                i*step, 
-                ((i+1)*step > this->p_height ? this->p_height : (i+1)*step), 
-                std::ref(pixels), 
-                ray_orig, 
-                &scaled_w
-            )
+        {
+            unique_lock<mutex> lock(this->pool_mtx);
+            this->frame_cv.wait(lock, [this, seen]{ 
+                return this->stopping || this->frame_id != seen; 
+            });
+            if (this->stopping) return;
+            seen = this->frame_id;
+        }
+
+        /* same split as always, just over the rows asked for */
+        float rows = this->frame_row_end - this->frame_row_start;
+        int step = ceil(rows / this->num_threads);
+        int start = this->frame_row_start + thread_id*step;
+        int end = this->frame_row_start + (thread_id+1)*step;
+        if (end > this->frame_row_end) end = this->frame_row_end;
+
+        this->split_work(
+            start, end, *this->frame_pixels, 
+            this->frame_ro, &this->frame_sw, thread_id
         );
-    }
 
-    for (auto& t : threads)
-    {
-        t.join();
+        {
+            lock_guard<mutex> lock(this->pool_mtx);
+            this->workers_done++;
+        }
+        this->done_cv.notify_one();
     }
 }
 
 void RayTracer::split_work(int start, int end, 
-        vector<Color>& pixels, vec3 ro, vec3* sw)
+        vector<Color>& pixels, vec3 ro, vec3* sw, int thread_id)
 {
     /*
         Each thread gets a number of rows of pixels to fill
         There is no locking structures because this is
          easily parallelizable
     */
+#ifdef RT_STATS
+    Stats::local().reset();
+    auto trace_start = chrono::steady_clock::now();
+#endif
     for (int i = start; i < end; i++)
     {
         for (int j = 0; j < this->p_width; j++)
@@ -152,10 +240,48 @@ void RayTracer::split_work(int start, int end,
             /* this is a lot of dereferencing ? do better? */
 
             stack<Object*> s;
+            int idx = (i - this->frame_row_start)*(int)(this->p_width) + j;
+
+            chrono::steady_clock::time_point px_start;
+            if (this->heatmap_mode == HEATMAP_TIME)
+                px_start = chrono::steady_clock::now();
+#ifdef RT_STATS
+            uint64_t tests_before = 
+                Stats::local().prim_tests + Stats::local().bvh_nodes;
+#endif
+
+            STAT_INC(camera_rays);
             this->trace_ray(&r, 0, s);
-            pixels[i*(int)(this->p_width) + j] = r.color.capMax(1.0f).capMin(0.0f);
+            pixels[idx] = r.color.capMax(1.0f).capMin(0.0f);
+
+            if (this->heatmap_mode == HEATMAP_TIME)
+            {
+                chrono::duration<float, micro> spent = 
+                    chrono::steady_clock::now() - px_start;
+                this->heatmap[idx] = spent.count();
+            }
+#ifdef RT_STATS
+            else if (this->heatmap_mode == HEATMAP_TESTS)
+            {
+                this->heatmap[idx] = (float)(
+                    Stats::local().prim_tests + Stats::local().bvh_nodes
+                    - tests_before
+                );
+            }
+#endif
         }
     }
+#ifdef RT_STATS
+    chrono::duration<double, milli> traced = 
+        chrono::steady_clock::now() - trace_start;
+    Stats::local().phase_ms[PHASE_TRACE] += traced.count();
+
+    /* 
+        The worker sticks around and resets its counters at the start
+         of every frame, so hand gen_rows() a copy of this frame's ones
+    */
+    this->thread_stats[thread_id] = Stats::local();
+#endif
 }  
 
 void RayTracer::define_viewing_system()
@@ -204,6 +330,8 @@ void RayTracer::trace_ray(Ray* ray, int depth, stack<Object*>& whences)
     // tuple<float, Object*> min = this->get_min_intersect(r, nullptr);
     // return this->shade_ray(r, get<0>(min), get<1>(min), depth);
 
+    STAT_DEPTH(depth);
+
     if (depth >= this->max_depth) 
     {
         ray->color = this->bkgcolor;
@@ -299,6 +427,7 @@ void RayTracer::shade_ray(Ray* ray, int depth, stack<Object*>& whences)
 
         /* intersect every object */
         vector<Object*> obj_vec;
+        STAT_INC(shadow_rays);
         this->get_all_intersects_in_distance(&rar, obj_vec, max_dist, dont_int);
 
         for (auto& obj : obj_vec) 
@@ -344,6 +473,7 @@ void RayTracer::shade_ray(Ray* ray, int depth, stack<Object*>& whences)
                 /* allows for colored shadows! */
 
                 obj_vec.clear();
+                STAT_INC(shadow_rays);
                 this->get_all_intersects_in_distance(&rar, obj_vec, max_dist, dont_int);
                 for (auto& obj : obj_vec)
                 {
@@ -498,6 +628,8 @@ void RayTracer::shade_ray(Ray* ray, int depth, stack<Object*>& whences)
 
             if (ndotI < 0) whences.push(ray->obj);
 
+            /* total internal reflection */
+            STAT_INC(reflect_rays);
             this->trace_ray(&transmit_ray, depth+1, whences);
         }
         else 
@@ -517,6 +649,7 @@ void RayTracer::shade_ray(Ray* ray, int depth, stack<Object*>& whences)
             transmit_ray.orig += transmit_ray.dir*0.001;
 
             whences.push(ray->obj);
+            STAT_INC(refract_rays);
             this->trace_ray(&transmit_ray, depth+1, whences);
         }
     }
@@ -530,6 +663,7 @@ void RayTracer::shade_ray(Ray* ray, int depth, stack<Object*>& whences)
         reflect_ray.dir.normalize();
         reflect_ray.orig += reflect_ray.dir*0.001;
         
+        STAT_INC(reflect_rays);
         this->trace_ray(&reflect_ray, depth+1, whences);
     }   
 
@@ -599,15 +733,6 @@ void RayTracer::get_all_intersects_in_distance(Ray* rar,
     }
 }
 
-float RayTracer::arbitrary_random(float low, float high)
-{
-    return (
-        low + static_cast <float> (rand()) 
-        / 
-        (static_cast <float> (RAND_MAX / (high - low)))
-    );
-}
-
 float RayTracer::calc_atten(float c1, float c2, float c3, float d)
 {
     /* 
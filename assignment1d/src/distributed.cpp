@@ -0,0 +1,637 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include "../include/utils.h"
+#include "../include/scene.h"
+#include "../include/distributed.h"
+
+using namespace std;
+
+/*
+    Buffered reads on a stream fd.
+    The worker uses it blocking, the coordinator only calls
+     read_more() once poll() said there is something there.
+*/
+struct Conn
+{
+    int fd = -1;
+    string buf;
+
+    /* false on eof or error */
+    bool read_more()
+    {
+        char tmp[65536];
+        ssize_t n = read(fd, tmp, sizeof(tmp));
+        if (n <= 0) return false;
+        buf.append(tmp, n);
+        return true;
+    }
+
+    /* pulls a full line out of buf if there is one */
+    bool get_line(string& line)
+    {
+        size_t nl = buf.find('\n');
+        if (nl == string::npos) return false;
+        line = buf.substr(0, nl);
+        buf.erase(0, nl + 1);
+        return true;
+    }
+};
+
+static bool send_all(int fd, const string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+static string read_file(string filename)
+{
+    ifstream inf{filename, ios::binary};
+    if (!inf) err_msg("Input file does not exist.");
+
+    stringstream contents;
+    contents << inf.rdbuf();
+    return contents.str();
+}
+
+/* same lines read_scene_lines() would give for the file */
+static vector<string> split_lines(const string& text)
+{
+    vector<string> lines;
+    size_t pos = 0, nl;
+    while ((nl = text.find('\n', pos)) != string::npos)
+    {
+        lines.push_back(text.substr(pos, nl - pos));
+        pos = nl + 1;
+    }
+    lines.push_back(text.substr(pos));
+    return lines;
+}
+
+static void write_ppm_bytes(string filename, int width, int height,
+        vector<unsigned char>& rgb)
+{
+    ofstream outf{ filename, ios_base::trunc };
+    if (!outf)
+    {
+        string msg = string("Error in creating '") +
+                        filename + "' output file.\n";
+        err_msg(msg);
+    }
+
+    outf << create_ppm_header("P3", width, height, 255);
+
+    string s = "";
+    for (size_t i = 0; i < rgb.size(); i += 3)
+    {
+        s += to_string(rgb[i]) + " " +
+             to_string(rgb[i+1]) + " " +
+             to_string(rgb[i+2]) + "\n";
+    }
+    outf << s;
+}
+
+/*********************************************************/
+/*                      transports                       */
+/*********************************************************/
+
+vector<int> PipeTransport::initial_workers()
+{
+    vector<int> fds;
+
+    /* don't want buffered output printed once per child */
+    cout.flush();
+    cerr.flush();
+
+    for (int i = 0; i < count; i++)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+            err_msg("Could not create socketpair.\n");
+
+        pid_t pid = fork();
+        if (pid == -1) err_msg("Could not fork worker.\n");
+
+        if (pid == 0)
+        {
+            close(sv[0]);
+            for (auto& fd : fds) close(fd);
+
+            run_worker(sv[1]);
+            _exit(0);
+        }
+
+        close(sv[1]);
+        fds.push_back(sv[0]);
+    }
+
+    return fds;
+}
+
+UnixTransport::~UnixTransport()
+{
+    if (listen_fd != -1)
+    {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+}
+
+static bool fill_unix_addr(string path, struct sockaddr_un& addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    path.copy(addr.sun_path, path.size());
+    return true;
+}
+
+int UnixTransport::listener()
+{
+    if (listen_fd != -1) return listen_fd;
+
+    struct sockaddr_un addr;
+    if (!fill_unix_addr(path, addr)) err_msg("Socket path too long.\n");
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) err_msg("Could not create socket.\n");
+
+    unlink(path.c_str());
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+        err_msg("Could not bind socket " + path + "\n");
+    if (listen(listen_fd, 16) == -1)
+        err_msg("Could not listen on socket " + path + "\n");
+
+    return listen_fd;
+}
+
+int UnixTransport::connect_to()
+{
+    struct sockaddr_un addr;
+    if (!fill_unix_addr(path, addr)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int TcpTransport::listener()
+{
+    if (listen_fd != -1) return listen_fd;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd == -1) err_msg("Could not create socket.\n");
+
+    int yes = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+        err_msg("Could not bind tcp port " + to_string(port) + "\n");
+    if (listen(listen_fd, 16) == -1)
+        err_msg("Could not listen on tcp port " + to_string(port) + "\n");
+
+    return listen_fd;
+}
+
+int TcpTransport::connect_to()
+{
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) != 0)
+        return -1;
+
+    int fd = -1;
+    for (struct addrinfo* p = res; p != nullptr; p = p->ai_next)
+    {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+Transport* make_transport(string endpoint)
+{
+    if (endpoint.compare(0, 5, "unix:") == 0)
+        return new UnixTransport(endpoint.substr(5));
+
+    if (endpoint.compare(0, 4, "tcp:") == 0)
+    {
+        vector<string> parts = split(endpoint.substr(4), ":");
+
+        if (parts.size() == 1 && is_number(parts[0], {}))
+            return new TcpTransport("", stoi(parts[0]));
+        if (parts.size() == 2 && is_number(parts[1], {}))
+            return new TcpTransport(parts[0], stoi(parts[1]));
+    }
+
+    err_msg(
+        string("Endpoint must be unix:<path>, tcp:<port> ") +
+        "or tcp:<host>:<port>\n"
+    );
+    return nullptr;
+}
+
+/*********************************************************/
+/*                        worker                         */
+/*********************************************************/
+
+void run_worker(int fd)
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    Conn c;
+    c.fd = fd;
+
+    AssetCache cache;
+    SceneView view;
+    RayTracer* r = nullptr;
+    vector<Color> pixels;
+
+    string line;
+    while (true)
+    {
+        if (!c.get_line(line))
+        {
+            if (!c.read_more()) break;
+            continue;
+        }
+
+        vector<string> tokens = split(line, " ");
+        if (tokens.size() == 0) continue;
+
+        if (tokens[0] == "quit") break;
+
+        if (tokens[0] == "scene" && tokens.size() == 2 && r == nullptr)
+        {
+            size_t n = stoul(tokens[1]);
+            while (c.buf.size() < n)
+            {
+                if (!c.read_more()) err_msg("Coordinator went away.\n");
+            }
+
+            string text = c.buf.substr(0, n);
+            c.buf.erase(0, n);
+
+            vector<string> lines = split_lines(text);
+            parse_view(lines, view);
+            r = make_tracer(view, cache.geometry(lines));
+
+            if (!send_all(fd,
+                    "ready " + to_string((int)view.out_width) + " " +
+                    to_string((int)view.out_height) + "\n"))
+                break;
+        }
+        else if (tokens[0] == "tile" && tokens.size() == 4 && r != nullptr)
+        {
+            int start = stoi(tokens[2]);
+            int end = stoi(tokens[3]);
+
+            r->gen_rows(pixels, start, end);
+
+            /* same rounding as put_all_normalized() */
+            string rgb;
+            rgb.reserve(pixels.size() * 3);
+            for (auto& p : pixels)
+            {
+                rgb += (char)(unsigned char)(int)(p.r*255);
+                rgb += (char)(unsigned char)(int)(p.g*255);
+                rgb += (char)(unsigned char)(int)(p.b*255);
+            }
+
+            string header =
+                "done " + tokens[1] + " " + tokens[2] + " " +
+                tokens[3] + " " + to_string(rgb.size()) + "\n";
+            if (!send_all(fd, header + rgb)) break;
+        }
+        else
+        {
+            cerr << "worker: ignoring '" << line << "'" << endl;
+        }
+    }
+
+    delete r;
+    close(fd);
+}
+
+/*********************************************************/
+/*                      coordinator                      */
+/*********************************************************/
+
+typedef chrono::steady_clock::time_point TimePoint;
+
+struct Tile
+{
+    int start, end;
+    bool done = false;
+    int outstanding = 0;    /* how many workers are on it right now */
+    TimePoint sent;
+};
+
+struct Peer
+{
+    Conn c;
+    bool alive = true;
+    bool ready = false;
+    int tile = -1;          /* tile being worked on, -1 when idle */
+
+    /* set while waiting for the rgb bytes after a done line */
+    bool in_body = false;
+    int body_tile;
+    size_t body_bytes;
+};
+
+static double ms_since(TimePoint t)
+{
+    chrono::duration<double, milli> d = chrono::steady_clock::now() - t;
+    return d.count();
+}
+
+double coordinate(string scene_file, Transport& transport, int tile_rows)
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    /* only the view is needed here, workers build the geometry */
+    string text = read_file(scene_file);
+    vector<string> lines = split_lines(text);
+
+    SceneView view;
+    parse_view(lines, view);
+    if (view.animated)
+        err_msg("Distributed rendering only does single frames.\n");
+
+    string out_file = output_name(scene_file, "");
+
+    int width = view.out_width;
+    int height = view.out_height;
+    if (tile_rows < 1) tile_rows = 1;
+
+    vector<Tile> tiles;
+    deque<int> queue;
+    for (int s = 0; s < height; s += tile_rows)
+    {
+        Tile t;
+        t.start = s;
+        t.end = min(s + tile_rows, height);
+        queue.push_back(tiles.size());
+        tiles.push_back(t);
+    }
+
+    vector<unsigned char> image(width * height * 3, 0);
+    string scene_msg = "scene " + to_string(text.size()) + "\n" + text;
+
+    vector<Peer> peers;
+    auto add_peer = [&](int fd) {
+        Peer p;
+        p.c.fd = fd;
+        if (!send_all(fd, scene_msg))
+        {
+            close(fd);
+            return;
+        }
+        peers.push_back(p);
+    };
+
+    for (auto& fd : transport.initial_workers()) add_peer(fd);
+
+    int listen_fd = transport.listener();
+    if (listen_fd != -1) cerr << "waiting for workers" << endl;
+
+    /* tile timing, for deciding when a tile is taking too long */
+    int done_count = 0;
+    double total_tile_ms = 0;
+    int reassigned = 0;
+
+    auto drop_peer = [&](Peer& p) {
+        p.alive = false;
+        close(p.c.fd);
+        if (p.tile != -1)
+        {
+            Tile& t = tiles[p.tile];
+            t.outstanding--;
+            if (!t.done && t.outstanding == 0) queue.push_front(p.tile);
+            p.tile = -1;
+        }
+    };
+
+    auto send_tile = [&](Peer& p, int id) {
+        Tile& t = tiles[id];
+        string msg =
+            "tile " + to_string(id) + " " +
+            to_string(t.start) + " " + to_string(t.end) + "\n";
+
+        p.tile = id;
+        t.outstanding++;
+        t.sent = chrono::steady_clock::now();
+
+        if (!send_all(p.c.fd, msg)) drop_peer(p);
+    };
+
+    auto start = chrono::steady_clock::now();
+
+    while (done_count < (int)tiles.size())
+    {
+        /* hand out work to anyone idle */
+        double avg = done_count ? total_tile_ms / done_count : 0;
+        double too_long = done_count ? max(2000.0, 4*avg) : 30000.0;
+
+        for (auto& p : peers)
+        {
+            if (!p.alive || !p.ready || p.tile != -1) continue;
+
+            if (!queue.empty())
+            {
+                int id = queue.front();
+                queue.pop_front();
+                if (!tiles[id].done) send_tile(p, id);
+                continue;
+            }
+
+            /* nothing queued, double up on the slowest straggler */
+            int worst = -1;
+            double worst_ms = too_long;
+            for (int i = 0; i < (int)tiles.size(); i++)
+            {
+                if (tiles[i].done || tiles[i].outstanding != 1) continue;
+                double t = ms_since(tiles[i].sent);
+                if (t > worst_ms)
+                {
+                    worst = i;
+                    worst_ms = t;
+                }
+            }
+
+            if (worst != -1)
+            {
+                reassigned++;
+                send_tile(p, worst);
+            }
+        }
+
+        int alive = 0;
+        for (auto& p : peers) alive += p.alive;
+        if (alive == 0 && listen_fd == -1)
+            err_msg("All workers are gone, can't finish the image.\n");
+
+        /* wait for something to happen */
+        vector<struct pollfd> fds;
+        vector<int> which;
+        if (listen_fd != -1)
+        {
+            fds.push_back({listen_fd, POLLIN, 0});
+            which.push_back(-1);
+        }
+        for (int i = 0; i < (int)peers.size(); i++)
+        {
+            if (!peers[i].alive) continue;
+            fds.push_back({peers[i].c.fd, POLLIN, 0});
+            which.push_back(i);
+        }
+
+        /* wake up now and then to check on stragglers */
+        if (poll(fds.data(), fds.size(), 100) <= 0) continue;
+
+        for (int k = 0; k < (int)fds.size(); k++)
+        {
+            if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            if (which[k] == -1)
+            {
+                int fd = accept(listen_fd, nullptr, nullptr);
+                if (fd != -1) add_peer(fd);
+                continue;
+            }
+
+            Peer& p = peers[which[k]];
+            if (!p.c.read_more())
+            {
+                drop_peer(p);
+                continue;
+            }
+
+            /* handle every complete message that arrived */
+            while (p.alive)
+            {
+                if (p.in_body)
+                {
+                    if (p.c.buf.size() < p.body_bytes) break;
+
+                    Tile& t = tiles[p.body_tile];
+                    if (!t.done)
+                    {
+                        memcpy(
+                            &image[t.start * width * 3],
+                            p.c.buf.data(), p.body_bytes
+                        );
+                        t.done = true;
+                        done_count++;
+                        total_tile_ms += ms_since(t.sent);
+                    }
+
+                    p.c.buf.erase(0, p.body_bytes);
+                    p.in_body = false;
+                    if (p.tile == p.body_tile)
+                    {
+                        t.outstanding--;
+                        p.tile = -1;
+                    }
+                    continue;
+                }
+
+                string line;
+                if (!p.c.get_line(line)) break;
+
+                vector<string> tokens = split(line, " ");
+                if (tokens.size() == 3 && tokens[0] == "ready")
+                {
+                    if (stoi(tokens[1]) != width || stoi(tokens[2]) != height)
+                    {
+                        cerr << "worker disagrees about the image size" << endl;
+                        drop_peer(p);
+                        break;
+                    }
+                    p.ready = true;
+                }
+                else if (tokens.size() == 5 && tokens[0] == "done")
+                {
+                    int id = stoi(tokens[1]);
+                    size_t n = stoul(tokens[4]);
+
+                    if (id < 0 || id >= (int)tiles.size() ||
+                        n != (size_t)(tiles[id].end - tiles[id].start) * width * 3)
+                    {
+                        cerr << "worker sent a bad tile" << endl;
+                        drop_peer(p);
+                        break;
+                    }
+
+                    p.in_body = true;
+                    p.body_tile = id;
+                    p.body_bytes = n;
+                }
+                else
+                {
+                    cerr << "worker sent '" << line << "'" << endl;
+                    drop_peer(p);
+                }
+            }
+        }
+    }
+
+    double ms = ms_since(start);
+
+    for (auto& p : peers)
+    {
+        if (!p.alive) continue;
+        send_all(p.c.fd, "quit\n");
+        close(p.c.fd);
+    }
+
+    /* reap local workers */
+    while (waitpid(-1, nullptr, WNOHANG) > 0);
+
+    if (reassigned)
+        cerr << reassigned << " slow tiles were handed out twice" << endl;
+
+    write_ppm_bytes(out_file, width, height, image);
+    return ms;
+}
@@ -0,0 +1,1445 @@
+#include <type_traits>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <typeinfo>
+#include <sstream>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <thread>
+#include <memory>
+#include <sys/stat.h>
+
+#include "../include/utils.h"
+#include "../include/vec3.h"
+#include "../include/ray.h"
+#include "../include/sphere.h"
+#include "../include/cylinder.h"
+#include "../include/triangle.h"
+#include "../include/mesh.h"
+#include "../include/material.h"
+#include "../include/color.h"
+#include "../include/light.h"
+#include "../include/texture.h"
+#include "../include/stats.h"
+
+#include "../include/scene.h"
+
+using namespace std;
+
+template <typename T>
+inline string ToString(T value)
+{
+    stringstream out;
+    out << scientific;
+    out << value;
+    return out.str();
+}
+
+/*
+    This used to all live in main().
+    Its still really just a bunch of file manip and error handling,
+     just split into the part that describes the view and the part
+     that describes the geometry so the geometry can be cached.
+    Any argument specifications is in the readme.
+*/
+
+static Color extract_only_color(string keyword, vector<string> tokens);
+static vec3 extract_only_vector(string keyword, vector<string> tokens);
+static float custom_stof(string tok);
+static int custom_stoi(string tok);
+static void validate_size(int got, int required, string key);
+static void end_condition(int cond, string msg);
+static void validate_tokens(vector<string> toks, vector<char> valids, string msg);
+static bool is_geometry_keyword(string keyword);
+
+static Color extract_only_color(string keyword, vector<string> tokens)
+{
+    validate_size(tokens.size(), 3, keyword);
+
+    validate_tokens(tokens, {'.'}, keyword + " r,g,b ");
+
+    float r = custom_stof(tokens[0]);
+    float g = custom_stof(tokens[1]);
+    float b = custom_stof(tokens[2]);
+
+    end_condition(
+        r > 1 || r < 0 || g > 1 || g < 0 || b > 1 || b < 0,
+        keyword + " r,g,b must be between 0 and 1.\n"
+    );
+
+    return Color(r, g, b);
+}
+
+static vec3 extract_only_vector(string keyword, vector<string> tokens)
+{
+    validate_size(tokens.size(), 3, keyword);
+
+    validate_tokens(tokens, {'.', '-'}, keyword + " x,y,z ");
+
+    return vec3(
+        custom_stof(tokens[0]),
+        custom_stof(tokens[1]),
+        custom_stof(tokens[2])
+    );
+}
+
+static float custom_stof(string tok)
+{
+    try
+    {
+        return stof(tok);
+    }
+    catch (invalid_argument& e)
+    {
+        end_condition(1, "Invalid argument to stof().\n");
+        return 0.0f;
+    }
+}
+
+static int custom_stoi(string tok)
+{
+    try
+    {
+        return stoi(tok);
+    }
+    catch (invalid_argument& e)
+    {
+        end_condition(1, "Invalid argument to stoi().\n");
+        return 0;
+    }
+}
+
+static void validate_size(int got, int required, string key)
+{
+    end_condition(
+        required != got,
+        string(((got > required) ? "Too many" : "Too few"))
+             + " values following keyword " + key + ".\n" +
+             "Refer to README for more specific input syntax.\n"
+    );
+}
+
+static void end_condition(int cond, string msg)
+{
+    if (cond) err_msg(msg);
+}
+
+static void validate_tokens(vector<string> toks, vector<char> valids, string msg)
+{
+    for (auto& tok : toks)
+    {
+        end_condition(
+            !is_number(tok, valids),
+            msg + "must be integers or floats.\n" +
+            "Refer to README for more specific input syntax.\n"
+        );
+    }
+}
+
+static bool is_geometry_keyword(string keyword)
+{
+    return (
+        keyword == "mtlcolor" ||
+        keyword == "sphere" ||
+        keyword == "cylinder" ||
+        keyword == "f" ||
+        keyword == "v" ||
+        keyword == "vn" ||
+        keyword == "vt" ||
+        keyword == "texture" ||
+        keyword == "bump" ||
+        keyword == "mesh"
+    );
+}
+
+/* FNV-1a, plenty for telling scene files apart */
+uint64_t hash_bytes(const string& s, uint64_t h)
+{
+    for (auto& c : s)
+    {
+        h ^= (unsigned char)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+vector<string> read_scene_lines(string filename)
+{
+    ifstream inf{filename};
+    if (!inf) err_msg("Input file does not exist.");
+
+    vector<string> lines;
+    string in_line;
+    while (!inf.eof())
+    {
+        getline(inf, in_line);
+        lines.push_back(in_line);
+    }
+
+    return lines;
+}
+
+void parse_view(vector<string>& lines, SceneView& view)
+{
+    bool eye_present = false;
+    bool view_present = false;
+    bool up_present = false;
+    bool bkg_or_cueing_present = false;
+    bool hfov_present = false;
+    bool size_present = false;
+
+    vec3 zeros;
+
+    for (auto& in_line : lines)
+    {
+        vector<string> tokens = split(in_line, " ");
+        if (tokens.size() == 0) continue;
+
+        string keyword = tokens[0];
+        tokens.erase(tokens.begin());
+
+        /* build_geometry() deals with these */
+        if (is_geometry_keyword(keyword)) continue;
+
+        if (keyword == "eye")
+        {
+            view.eye_pos = extract_only_vector(keyword, tokens);
+            eye_present = true;
+        }
+        else if (keyword == "viewdir")
+        {
+            view.view_dir = extract_only_vector(keyword, tokens);
+            view_present = true;
+            end_condition(
+                view.view_dir == zeros,
+                string("viewdir must be non-zero\n") +
+                    "Tolerance: " + ToString(zeros.epsilon) + "\n"
+            );
+        }
+        else if (keyword == "updir")
+        {
+            view.up_dir = extract_only_vector(keyword, tokens);
+            up_present = true;
+
+            end_condition(
+                view.up_dir == zeros,
+                string("updir must be non-zero\n") +
+                    "Tolerance: " + ToString(zeros.epsilon) + "\n"
+            );
+        }
+        else if (keyword == "hfov")
+        {
+            validate_size(tokens.size(), 1, keyword);
+
+            end_condition(
+                !is_number(tokens[0], {'.'}),
+                "hfov must be a positive integer or float.\n"
+            );
+
+            view.hfov = custom_stof(tokens[0]);
+            hfov_present = true;
+
+            end_condition(
+                view.hfov > 360 || view.hfov < 9e-13,
+                "hfov must be between 9e-13 and 360 degrees.\n"
+            );
+        }
+        else if (keyword == "imsize")
+        {
+            /* values to extract: width and height */
+            validate_size(tokens.size(), 2, keyword);
+
+            validate_tokens(tokens, {'.'}, "imsize width ");
+
+            /*
+                Width and height should now be numbers
+                Still error handling just in case
+                Also, I'm allowing floats to be inputs
+                They will just be rounded to the nearest int by stoi()
+            */
+            view.out_width = custom_stoi(tokens[0]);
+            view.out_height = custom_stoi(tokens[1]);
+
+            end_condition(
+                view.out_width < 1 || view.out_height < 1,
+                "width and height must be greater than 0\n"
+            );
+
+            size_present = true;
+        }
+        else if (keyword == "bkgcolor")
+        {
+            validate_size(tokens.size(), 4, keyword);
+
+            view.bkgcolor = extract_only_color(
+                keyword, v_slice(tokens, 0, 2, 1)
+            );
+
+            validate_tokens({tokens[3]}, {'.'}, "bkgcolor eta ");
+            view.bkg_eta = custom_stof(tokens[3]);
+
+            bkg_or_cueing_present = true;
+        }
+        else if (keyword == "projection")
+        {
+            validate_size(tokens.size(), 1, keyword);
+
+            end_condition(
+                tokens[0] != "parallel",
+                string("Token following keyword ") +
+                    "'projection' must be 'parallel'.\n"
+            );
+
+            view.parallel = true;
+        }
+        else if (keyword == "heatmap")
+        {
+            validate_size(tokens.size(), 1, keyword);
+
+            if (tokens[0] == "time") view.heatmap_mode = HEATMAP_TIME;
+            else if (tokens[0] == "tests") view.heatmap_mode = HEATMAP_TESTS;
+            else
+            {
+                end_condition(
+                    1,
+                    string("Token following keyword ") +
+                        "'heatmap' must be 'time' or 'tests'.\n"
+                );
+            }
+
+#ifndef RT_STATS
+            end_condition(
+                view.heatmap_mode == HEATMAP_TESTS,
+                "heatmap tests needs the render stats, build with 'make STATS=1'.\n"
+            );
+#endif
+        }
+        else if (keyword == "threadcount")
+        {
+            validate_size(tokens.size(), 1, keyword);
+
+            validate_tokens(tokens, {}, "threadcount ");
+
+            view.threads = custom_stoi(tokens[0]);
+            end_condition(
+                view.threads < 1,
+                "threadcount must be greater than 0\n"
+            );
+        }
+        else if (keyword == "light")
+        {
+            validate_size(tokens.size(), 7, keyword);
+
+            string type_light = tokens[3];
+
+            vec3 pos = extract_only_vector(
+                keyword, v_slice(tokens, 0, 2, 1)
+            );
+            Color col = extract_only_color(
+                keyword, v_slice(tokens, 4, 6, 1)
+            );
+
+            end_condition(
+                !is_number(type_light, {}),
+                "light w must be 1 (point) or 0 (directional).\n"
+            );
+
+            int w = custom_stoi(type_light);
+
+            if (w == 0)
+            {
+                end_condition(
+                    pos == zeros,
+                    "directional light direction must be non-zero\n"
+                );
+
+                view.lights.push_back(
+                    new DirectionalLight(
+                        pos,
+                        col
+                    )
+                );
+                continue;
+            }
+
+            if (w == 1)
+            {
+                view.lights.push_back(
+                    new PointLight(
+                        pos,
+                        col
+                    )
+                );
+                continue;
+            }
+
+            end_condition(
+                1,
+                "light w must be 1 (point) or 0 (directional).\n"
+            );
+        }
+        else if (keyword == "attlight")
+        {
+            validate_size(tokens.size(), 10, keyword);
+
+            string type_light = tokens[3];
+
+            vec3 pos = extract_only_vector(
+                keyword, v_slice(tokens, 0, 2, 1)
+            );
+            Color col = extract_only_color(
+                keyword, v_slice(tokens, 4, 6, 1)
+            );
+            vec3 falloff = extract_only_vector(
+                keyword, v_slice(tokens, 7, 9, 1)
+            );
+
+            end_condition(
+                falloff.x < 0 || falloff.y < 0 || falloff.z < 0,
+                "falloff constants must be positive or zero.\n"
+            );
+
+            end_condition(
+                !is_number(type_light, {}),
+                "attlight w must be 1 (point).\n"
+            );
+
+            int w = custom_stoi(type_light);
+
+            if (w == 1)
+            {
+                view.lights.push_back(
+                    new AttenPointLight(
+                        pos,
+                        col,
+                        falloff.x,
+                        falloff.y,
+                        falloff.z
+                    )
+                );
+                continue;
+            }
+
+            end_condition(1, "attlight must be point light (0).\n");
+        }
+        else if (keyword == "frames")
+        {
+            validate_size(tokens.size(), 2, keyword);
+
+            validate_tokens(tokens, {}, "frames first/last ");
+
+            view.first_frame = custom_stoi(tokens[0]);
+            view.last_frame = custom_stoi(tokens[1]);
+
+            end_condition(
+                view.last_frame < view.first_frame,
+                "frames last must not be before first\n"
+            );
+
+            view.animated = true;
+        }
+        else if (keyword == "key")
+        {
+            /* key <frame> <eye|viewdir|updir> x y z */
+            /* key <frame> light <index> x y z */
+            end_condition(
+                tokens.size() != 5 && tokens.size() != 6,
+                "Incorrect token amount for keyword 'key'.\n"
+            );
+
+            validate_tokens({tokens[0]}, {}, "key frame ");
+            int frame = custom_stoi(tokens[0]);
+            string what = tokens[1];
+
+            if (what == "light")
+            {
+                validate_size(tokens.size(), 6, keyword);
+                validate_tokens({tokens[2]}, {}, "key light index ");
+
+                int idx = custom_stoi(tokens[2]);
+                end_condition(idx < 1, "key light index starts at 1\n");
+
+                view.light_tracks[idx-1].add(
+                    frame, extract_only_vector(keyword, v_slice(tokens, 3, 5, 1))
+                );
+                continue;
+            }
+
+            validate_size(tokens.size(), 5, keyword);
+            vec3 val = extract_only_vector(keyword, v_slice(tokens, 2, 4, 1));
+
+            if (what == "eye") view.eye_track.add(frame, val);
+            else if (what == "viewdir" || what == "updir")
+            {
+                end_condition(
+                    val == zeros,
+                    "key " + what + " must be non-zero\n"
+                );
+
+                if (what == "viewdir") view.view_track.add(frame, val);
+                else view.up_track.add(frame, val);
+            }
+            else 
+            {
+                end_condition(
+                    1,
+                    string("Token following key frame must be ") +
+                        "'eye', 'viewdir', 'updir' or 'light'.\n"
+                );
+            }
+        }
+        else if (keyword == "depthcueing")
+        {
+            validate_size(tokens.size(), 7, keyword);
+
+            vector<string> coefs = v_slice(tokens, 3, 6, 1);
+
+            view.cueingcolor = extract_only_color(
+                keyword, v_slice(tokens, 0, 2, 1)
+            );
+
+            validate_tokens(coefs, {'.'}, "depthcueing coefs ");
+
+            view.amax = custom_stof(coefs[0]);
+            view.amin = custom_stof(coefs[1]);
+            view.dmax = custom_stof(coefs[2]);
+            view.dmin = custom_stof(coefs[3]);
+
+            bkg_or_cueing_present = true;
+            view.cueing = true;
+        }
+        else
+        {
+            end_condition(
+                keyword.length() < 2 ||
+                (keyword[0] != '/' || keyword[1] != '/'),
+                string("Invalid Keyword: '") + keyword + "'\n"
+            );
+        }
+    }
+
+    if (!eye_present || !view_present ||
+        !up_present || !bkg_or_cueing_present ||
+        !hfov_present || !size_present)
+    {
+        string msg = string("");
+        msg = msg + "All following keywords must be present:\n" +
+            "imsize, eye, viewdir, hfov, updir, bkgcolor/depthcueing\n";
+        err_msg(msg);
+    }
+
+    bool has_keys = 
+        !view.eye_track.empty() || !view.view_track.empty() || 
+        !view.up_track.empty() || !view.light_tracks.empty();
+    end_condition(
+        has_keys && !view.animated,
+        "key needs a 'frames' range to go with it\n"
+    );
+
+    for (auto& kv : view.light_tracks)
+    {
+        end_condition(
+            kv.first >= (int)view.lights.size(),
+            "key light index is past the number of lights\n"
+        );
+    }
+}
+
+Geometry* build_geometry(vector<string>& lines, AssetCache& cache)
+{
+    /* freed again if a bad line makes err_msg throw (server mode) */
+    unique_ptr<Geometry> owned(new Geometry);
+    Geometry* geo = owned.get();
+    vector<Material*>& materials = geo->materials;
+    vector<Object*>& objects = geo->objects;
+
+    bool material_applied = false;
+    bool texture_applied = false;
+    bool normal_map_applied = false;
+    vector<Texture*> textures;
+    vector<NormalMap*> normals;
+
+    /* for triangles, starting flat */
+    vector<vec3> vertices;
+    vector<vec3> vertex_normals;
+    vector<vec3> vertex_texture_coords;
+
+    vector<vector<vec3*>> triangle_defs;
+    vector<vector<vec3*>> vertex_normal_defs;
+    vector<vector<vec3*>> vertex_texture_coord_defs;
+    vector<vector<Texture*>> texture_defs;
+    vector<vector<NormalMap*>> normal_defs;
+
+    vec3 zeros;
+
+    bool meshing = false;
+    vector<vector<int>> mesh_face_indices;
+    vector<int> mesh_levels;
+    int mesh_face_counter = 0;
+
+    STAT_PHASE(PHASE_PARSE);
+    for (auto& in_line : lines)
+    {
+        /* gets line and splits into tokens */
+        vector<string> tokens = split(in_line, " ");
+        if (tokens.size() == 0) continue;
+
+        string keyword = tokens[0];
+        tokens.erase(tokens.begin());
+
+        if (material_applied && keyword == "sphere")
+        {
+            validate_size(tokens.size(), 4, keyword);
+
+            end_condition(
+                !is_number(tokens[3], {'.'}),
+                "circle radius must be positive integer or float.\n"
+            );
+
+            float r = custom_stof(tokens[3]);
+            end_condition(
+                r < zeros.epsilon,
+                string("") + "sphere radius must be non-zero\n" +
+                    "Tolerance: " + ToString(zeros.epsilon) + "\n"
+            );
+
+            tokens.erase(tokens.end());
+
+            vec3 cent = extract_only_vector(keyword, tokens);
+
+            Texture* text = nullptr;
+
+            if (texture_applied) text = textures[textures.size()-1];
+
+            NormalMap* nmap = nullptr;
+            if (normal_map_applied) nmap = normals[normals.size()-1];
+
+            objects.push_back(new Sphere(
+                cent, r, materials[materials.size()-1], text, nmap
+            ));
+            continue;
+        }
+        else if (material_applied && keyword == "cylinder")
+        {
+            validate_size(tokens.size(), 8, keyword);
+
+            validate_tokens(
+                v_slice(tokens, 6, 7, 1), {'.'},
+                "cylinder radius and length "
+            );
+
+            float r = custom_stof(tokens[6]);
+            float l = custom_stof(tokens[7]);
+
+            end_condition(
+                r < zeros.epsilon || l < zeros.epsilon,
+                string("cylinder radius/length must be non-zero\n") +
+                    "Tolerance: " + ToString(zeros.epsilon) + "\n"
+            );
+
+            tokens.erase(tokens.end());
+            tokens.erase(tokens.end());
+
+            vec3 c = extract_only_vector(keyword, v_slice(tokens, 0, 2, 1));
+            vec3 d = extract_only_vector(keyword, v_slice(tokens, 3, 5, 1));
+
+            end_condition(
+                d == zeros,
+                string("cylinder direction must be non-zero\n") +
+                    "Tolerance: " + ToString(zeros.epsilon) + "\n"
+            );
+
+            // Texture* text = nullptr;
+            // if (texture_applied) text = textures[textures.size()-1];
+            objects.push_back(new Cylinder(
+                c, d, r, l, materials[materials.size()-1]/*, text*/
+            ));
+            continue;
+        }
+        else if (material_applied && keyword == "f")
+        {
+            if (tokens.size() != 3 && tokens.size() != 4)
+            {
+                string msg = string(
+                    ((tokens.size() > 3) ? "Too many" : "Too few")
+                ) + " values following keyword 'f'.\n"
+                  + "Syntax: f <v1> <v2> <v3>\n";
+                err_msg(msg);
+            }
+
+            vector<string> toks = split_vector(tokens, "//");
+            vector<string> slash_toks = split_vector(tokens, "/");
+
+            vec3* tri_d = nullptr;
+            vec3* vert_d = nullptr;
+            vec3* text_d = nullptr;
+
+            if (toks.size() == 6)
+            {
+                tri_d = new vec3(extract_only_vector(
+                    keyword, v_slice(toks, 0, 4, 2)
+                ));
+                vert_d = new vec3(extract_only_vector(
+                    keyword, v_slice(toks, 1, 5, 2)
+                ));
+            }
+            else if (slash_toks.size() == 6)
+            {
+                tri_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 0, 4, 2)
+                ));
+                text_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 1, 5, 2)
+                ));
+            }
+            else if (slash_toks.size() == 9)
+            {
+                tri_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 0, 6, 3)
+                ));
+                text_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 1, 7, 3)
+                ));
+                vert_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 2, 8, 3)
+                ));
+            }
+            /* special case because kiwi was in quads */
+            else if (slash_toks.size() == 12)
+            {
+                tri_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 0, 6, 3)
+                ));
+                /* text_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 1, 7, 3)
+                )); */
+                vert_d = new vec3(extract_only_vector(
+                    keyword, v_slice(slash_toks, 2, 8, 3)
+                ));
+
+                triangle_defs[triangle_defs.size()-1]
+                    .push_back(tri_d);
+                vertex_normal_defs[vertex_normal_defs.size()-1]
+                    .push_back(vert_d);
+                vertex_texture_coord_defs[vertex_texture_coord_defs.size()-1]
+                    .push_back(text_d);
+
+                if (meshing) mesh_face_indices[mesh_face_indices.size()-1]
+                                .push_back(mesh_face_counter++);
+
+                /* cant do slicing here because last is before first */
+
+                vector<string> tri = {
+                    slash_toks[6], slash_toks[9], slash_toks[0]
+                };
+                // tex = {
+                //     slash_toks[7], slash_toks[10], slash_toks[1]
+                // };
+                vector<string> nor = {
+                    slash_toks[8], slash_toks[11], slash_toks[2]
+                };
+
+                tri_d = new vec3(extract_only_vector(keyword, tri));
+                // text_d = new vec3(extract_only_vector(keyword, tex));
+                vert_d = new vec3(extract_only_vector(keyword, nor));
+
+                triangle_defs[triangle_defs.size()-1]
+                    .push_back(tri_d);
+                vertex_normal_defs[vertex_normal_defs.size()-1]
+                    .push_back(vert_d);
+                vertex_texture_coord_defs[vertex_texture_coord_defs.size()-1]
+                    .push_back(text_d);
+
+                if (meshing) mesh_face_indices[mesh_face_indices.size()-1]
+                                .push_back(mesh_face_counter++);
+
+                Texture* texture_d = nullptr;
+                if (texture_applied)
+                    texture_d = textures[textures.size()-1];
+
+                texture_defs[texture_defs.size()-1]
+                    .push_back(texture_d);
+                texture_defs[texture_defs.size()-1]
+                    .push_back(texture_d);
+
+                NormalMap* nmap = nullptr;
+                if (normal_map_applied)
+                    nmap = normals[normals.size()-1];
+                normal_defs[normal_defs.size()-1]
+                    .push_back(nmap);
+                normal_defs[normal_defs.size()-1]
+                    .push_back(nmap);
+
+                continue;
+            }
+            else
+            {
+                tri_d = new vec3(extract_only_vector(keyword, tokens));
+            }
+
+            Texture* texture_d = nullptr;
+            if (texture_applied)
+                texture_d = textures[textures.size()-1];
+
+            texture_defs[texture_defs.size()-1]
+                .push_back(texture_d);
+
+            NormalMap* nmap = nullptr;
+            if (normal_map_applied)
+                nmap = normals[normals.size()-1];
+
+            normal_defs[normal_defs.size()-1]
+                .push_back(nmap);
+
+            triangle_defs[triangle_defs.size()-1]
+                .push_back(tri_d);
+            vertex_normal_defs[vertex_normal_defs.size()-1]
+                .push_back(vert_d);
+            vertex_texture_coord_defs[vertex_texture_coord_defs.size()-1]
+                .push_back(text_d);
+
+            if (meshing) mesh_face_indices[mesh_face_indices.size()-1]
+                            .push_back(mesh_face_counter++);
+
+            continue;
+        }
+        else if (keyword != "//" &&
+                 keyword != "v" &&
+                 keyword != "vn" &&
+                 keyword != "vt" &&
+                 keyword != "texture" &&
+                 keyword != "bump" &&
+                 keyword != "mesh")
+        {
+            material_applied = false;
+            texture_applied = false;
+            normal_map_applied = false;
+        }
+
+        /* end if an object is specified with no material provided */
+        if (!material_applied)
+        {
+            end_condition(
+                keyword == "circle" ||
+                keyword == "cylinder" ||
+                keyword == "f",
+                keyword + " must follow a material specification\n"
+            );
+        }
+
+        /*
+            anything else that isn't geometry belongs to parse_view(),
+             it still had to reset the material state above though
+        */
+        if (!is_geometry_keyword(keyword)) continue;
+
+        if (keyword == "mtlcolor")
+        {
+            end_condition(
+                tokens.size() != 14 && tokens.size() != 12,
+                "Incorrect number of tokens to 'mtlcolor'\n"
+            );
+
+            if (tokens.size() == 14)
+            {
+                vector<string> coefficients = v_slice(tokens, 6, 13, 1);
+
+                Color diffuse = extract_only_color(
+                    keyword, v_slice(tokens, 0, 2, 1)
+                );
+
+                Color specular = extract_only_color(
+                    keyword, v_slice(tokens, 3, 5, 1)
+                );
+
+                Color alpha = extract_only_color(
+                    keyword, v_slice(tokens, 10, 12, 1)
+                );
+
+                validate_tokens(coefficients, {'.'}, "mtlcolor coeffs ");
+
+                Material* m = new Material(
+                    diffuse,
+                    specular,
+                    custom_stof(coefficients[0]), /* ka */
+                    custom_stof(coefficients[1]), /* kd */
+                    custom_stof(coefficients[2]), /* ks */
+                    custom_stof(coefficients[3]), /* n */
+                    alpha.r,
+                    alpha.g,
+                    alpha.b,
+                    true,
+                    custom_stof(coefficients[7]) /* index of refraction (eta) */
+                );
+
+                materials.push_back(m);
+                material_applied = true;
+            }
+            else
+            {
+                vector<string> coefficients = v_slice(tokens, 6, 11, 1);
+
+                Color diffuse = extract_only_color(
+                    keyword, v_slice(tokens, 0, 2, 1)
+                );
+
+                Color specular = extract_only_color(
+                    keyword, v_slice(tokens, 3, 5, 1)
+                );
+
+                validate_tokens(coefficients, {'.'}, "mtlcolor coeffs ");
+
+                Material* m = new Material(
+                    diffuse,
+                    specular,
+                    custom_stof(coefficients[0]), /* ka */
+                    custom_stof(coefficients[1]), /* kd */
+                    custom_stof(coefficients[2]), /* ks */
+                    custom_stof(coefficients[3]), /* n */
+                    custom_stof(coefficients[4]),
+                    0, 0, false,
+                    custom_stof(coefficients[5]) /* index of refraction (eta) */
+                );
+
+                materials.push_back(m);
+                material_applied = true;
+            }
+
+            triangle_defs.push_back(vector<vec3*>());
+            vertex_normal_defs.push_back(vector<vec3*>());
+            vertex_texture_coord_defs.push_back(vector<vec3*>());
+            texture_defs.push_back(vector<Texture*>());
+            normal_defs.push_back(vector<NormalMap*>());
+        }
+        else if (keyword == "v")
+        {
+            validate_size(tokens.size(), 3, keyword);
+
+            vertices.push_back(
+                extract_only_vector(keyword, tokens)
+            );
+        }
+        else if (keyword == "vn")
+        {
+            validate_size(tokens.size(), 3, keyword);
+
+            vertex_normals.push_back(
+                extract_only_vector(keyword, tokens)
+            );
+        }
+        else if (keyword == "vt")
+        {
+            validate_size(tokens.size(), 2, keyword);
+
+            tokens.push_back("0");
+
+            vertex_texture_coords.push_back(
+                extract_only_vector(keyword, tokens)
+            );
+        }
+        else if (keyword == "texture")
+        {
+            validate_size(tokens.size(), 1, keyword);
+
+            textures.push_back(cache.texture(tokens[0]));
+
+            texture_applied = true;
+        }
+        else if (keyword == "bump")
+        {
+            validate_size(tokens.size(), 1, keyword);
+
+            normals.push_back(cache.normal_map(tokens[0]));
+            normal_map_applied = true;
+        }
+        else if (keyword == "mesh")
+        {
+            end_condition(
+                tokens.size() != 2 && tokens.size() != 1,
+                "Incorrect token amount for keyword 'mesh'.\n"
+            );
+
+            if (tokens[0] == "start")
+            {
+                end_condition(
+                    meshing,
+                    "cannot start mesh before stopping currently applied mesh\n"
+                );
+
+                meshing = true;
+                mesh_face_indices.push_back(vector<int>());
+
+                int p = 0;
+                if (tokens.size() == 2)
+                    p = custom_stoi(tokens[1]);
+                mesh_levels.push_back(p);
+            }
+            else if (tokens[0] == "stop")
+            {
+                end_condition(
+                    !meshing,
+                    "cannot stop mesh when no mesh in progress\n"
+                );
+
+                meshing = false;
+            }
+            else
+            {
+                end_condition(
+                    1,
+                    string("value") +
+                    "following keyword " +
+                    "'mesh' must be 'stop' or 'start'\n"
+                );
+            }
+        }
+        else
+        {
+            end_condition(
+                1,
+                string("Invalid Keyword: '") + keyword + "'\n"
+            );
+        }
+    }
+    STAT_PHASE_STOP(PHASE_PARSE);
+
+    /* create triangles and check that all vertices were specified properly */
+    int first_triangle_index = objects.size();
+    for (int i = 0; i < triangle_defs.size(); i++)
+    {
+        for (int j = 0; j < triangle_defs[i].size(); j++)
+        {
+            vec3* norm1=nullptr; vec3* norm2=nullptr; vec3* norm3=nullptr;
+            vec3* text1=nullptr; vec3* text2=nullptr; vec3* text3=nullptr;
+            Texture* t_texture = nullptr;
+            NormalMap* t_normal = nullptr;
+
+            if (triangle_defs[i][j] == nullptr)
+                err_msg("This shouldn't have happened.\n");
+
+            int v1 = (int)triangle_defs[i][j]->x;
+            int v2 = (int)triangle_defs[i][j]->y;
+            int v3 = (int)triangle_defs[i][j]->z;
+
+            delete triangle_defs[i][j];
+
+            int vcnt = vertices.size();
+            end_condition(
+                v1 <= 0 || v1 > vcnt || v2 <= 0 || v2 > vcnt
+                || v3 <= 0 || v3 > vcnt,
+                "Invalid vertex index specified\n"
+            );
+
+            if (vertex_normal_defs[i][j] != nullptr)
+            {
+                int vn1 = (int)vertex_normal_defs[i][j]->x;
+                int vn2 = (int)vertex_normal_defs[i][j]->y;
+                int vn3 = (int)vertex_normal_defs[i][j]->z;
+
+                int vncnt = vertex_normals.size();
+
+                end_condition(
+                    vn1 <= 0 || vn1 > vncnt ||
+                    vn2 <= 0 || vn2 > vncnt ||
+                    vn3 <= 0 || vn3 > vncnt,
+                    "Invalid vertex normal index specified\n"
+                );
+
+                norm1 = &vertex_normals[vn1-1];
+                norm2 = &vertex_normals[vn2-1];
+                norm3 = &vertex_normals[vn3-1];
+
+                delete vertex_normal_defs[i][j];
+            }
+
+            if (vertex_texture_coord_defs[i][j] != nullptr) {
+                int vt1 = (int)vertex_texture_coord_defs[i][j]->x;
+                int vt2 = (int)vertex_texture_coord_defs[i][j]->y;
+                int vt3 = (int)vertex_texture_coord_defs[i][j]->z;
+
+                int vtcnt = vertex_texture_coords.size();
+
+                end_condition(
+                    vt1 <= 0 || vt1 > vtcnt ||
+                    vt2 <= 0 || vt2 > vtcnt ||
+                    vt3 <= 0 || vt3 > vtcnt,
+                    "Invalid vertex texture index specified\n"
+                );
+
+                text1 = &vertex_texture_coords[vt1-1];
+                text2 = &vertex_texture_coords[vt2-1];
+                text3 = &vertex_texture_coords[vt3-1];
+
+                delete vertex_texture_coord_defs[i][j];
+
+                assert(
+                    normal_defs[i][j] != nullptr ||
+                    texture_defs[i][j] != nullptr
+                );
+
+                if (texture_defs[i][j] != nullptr)
+                    t_texture = texture_defs[i][j];
+                if (normal_defs[i][j] != nullptr)
+                    t_normal = normal_defs[i][j];
+            }
+
+            objects.push_back(
+                new Triangle(
+                    &vertices[v1-1],
+                    &vertices[v2-1],
+                    &vertices[v3-1],
+                    norm1, norm2, norm3,
+                    text1, text2, text3,
+                    materials[i], t_texture, t_normal
+                )
+            );
+        }
+    }
+
+    STAT_PHASE(PHASE_BUILD);
+    vector<Object*> polys;
+    for (int i = mesh_face_indices.size()-1; i >= 0; i--)
+    {
+        for (int j = mesh_face_indices[i].size()-1; j >= 0; j--)
+        {
+            int t_offset = mesh_face_indices[i][j];
+
+            polys.push_back(objects[first_triangle_index + t_offset]);
+            objects.erase(objects.begin() + first_triangle_index + t_offset);
+        }
+
+        objects.push_back(new Mesh(polys, mesh_levels[i]));
+        polys.clear();
+    }
+    STAT_PHASE_STOP(PHASE_BUILD);
+
+    return owned.release();
+}
+
+AssetCache::~AssetCache()
+{
+    for (auto& kv : geometries) delete kv.second;
+    for (auto& kv : textures) delete kv.second;
+    for (auto& kv : normals) delete kv.second;
+}
+
+uint64_t AssetCache::file_hash(string filename)
+{
+    /*
+        Hashing a big P3 file still means reading all of it,
+         so remember the answer until the file is touched again
+    */
+    struct stat st;
+    if (stat(filename.c_str(), &st) == -1)
+        err_msg("Failed to open file: " + filename);
+
+    auto found = file_hashes.find(filename);
+    if (found != file_hashes.end() &&
+        found->second.size == (long long)st.st_size &&
+        found->second.mtime == (long long)st.st_mtime)
+        return found->second.hash;
+
+    ifstream inf{filename, ios::binary};
+    if (!inf) err_msg("Failed to open file: " + filename);
+
+    stringstream contents;
+    contents << inf.rdbuf();
+
+    FileKey k;
+    k.size = st.st_size;
+    k.mtime = st.st_mtime;
+    k.hash = hash_bytes(contents.str());
+    file_hashes[filename] = k;
+
+    return k.hash;
+}
+
+Texture* AssetCache::texture(string filename)
+{
+    uint64_t h = file_hash(filename);
+
+    auto found = textures.find(h);
+    if (found != textures.end()) return found->second;
+
+    Texture* t = read_ppm_to_texture(filename);
+    textures[h] = t;
+    return t;
+}
+
+NormalMap* AssetCache::normal_map(string filename)
+{
+    uint64_t h = file_hash(filename);
+
+    auto found = normals.find(h);
+    if (found != normals.end()) return found->second;
+
+    NormalMap* n = read_ppm_to_normal(filename);
+    normals[h] = n;
+    return n;
+}
+
+Geometry* AssetCache::geometry(vector<string>& lines)
+{
+    /*
+        Key is every geometry line in order, plus the contents of
+         any texture or bump map those lines pull in.
+        View lines (eye, lights, ...) don't change the key.
+    */
+    uint64_t key = 14695981039346656037ULL;
+    vector<uint64_t> files;
+    for (auto& in_line : lines)
+    {
+        vector<string> tokens = split(in_line, " ");
+        if (tokens.size() == 0 || !is_geometry_keyword(tokens[0])) continue;
+
+        key = hash_bytes(in_line, key);
+        key = hash_bytes("\n", key);
+
+        if ((tokens[0] == "texture" || tokens[0] == "bump") &&
+            tokens.size() == 2)
+        {
+            uint64_t fh = file_hash(tokens[1]);
+            key = hash_bytes(string((char*)&fh, sizeof(fh)), key);
+            files.push_back(fh);
+        }
+    }
+
+    auto found = geometries.find(key);
+    if (found != geometries.end())
+    {
+        hits++;
+        return found->second;
+    }
+
+    misses++;
+    Geometry* geo = nullptr;
+    try
+    {
+        geo = build_geometry(lines, *this);
+    }
+    catch (InputError& e)
+    {
+        /* whatever textures the failed build decoded aren't used by anything */
+        drop_unused_textures();
+        throw;
+    }
+
+    geometries[key] = geo;
+    geometry_files[key] = files;
+    geometry_order.push_back(key);
+
+    /* oldest one goes first, along with the textures only it used */
+    bool evicted = false;
+    while ((int)geometry_order.size() > max_geometries)
+    {
+        delete geometries[geometry_order.front()];
+        geometries.erase(geometry_order.front());
+        geometry_files.erase(geometry_order.front());
+        geometry_order.pop_front();
+        evicted = true;
+    }
+    if (evicted) drop_unused_textures();
+
+    return geo;
+}
+
+void AssetCache::drop_unused_textures()
+{
+    set<uint64_t> used;
+    for (auto& kv : geometry_files)
+        used.insert(kv.second.begin(), kv.second.end());
+
+    for (auto it = textures.begin(); it != textures.end(); )
+    {
+        if (used.count(it->first)) { it++; continue; }
+        delete it->second;
+        it = textures.erase(it);
+    }
+
+    for (auto it = normals.begin(); it != normals.end(); )
+    {
+        if (used.count(it->first)) { it++; continue; }
+        delete it->second;
+        it = normals.erase(it);
+    }
+}
+
+RayTracer* make_tracer(SceneView& view, Geometry* geo)
+{
+    RayTracer* r = new RayTracer(
+        view.eye_pos,
+        view.view_dir,
+        view.up_dir,
+        view.hfov,
+        view.out_width,
+        view.out_height,
+        view.bkgcolor,
+        view.bkg_eta,
+        &geo->objects,
+        &view.lights,
+        view.parallel,
+        view.cueing,
+        view.amin,
+        view.amax,
+        view.dmin,
+        view.dmax,
+        view.cueingcolor,
+        view.threads
+    );
+
+    r->enable_heatmap(view.heatmap_mode);
+    return r;
+}
+
+void apply_frame(SceneView& view, RayTracer* r, int frame)
+{
+    vec3 e = view.eye_track.empty() ? view.eye_pos : view.eye_track.at(frame);
+    vec3 v = view.view_track.empty() ? view.view_dir : view.view_track.at(frame);
+    vec3 u = view.up_track.empty() ? view.up_dir : view.up_track.at(frame);
+
+    /* two keys pointing opposite ways could blend to nothing */
+    vec3 zeros;
+    if (v == zeros) v = view.view_dir;
+    if (u == zeros) u = view.up_dir;
+
+    r->set_camera(e, v, u);
+
+    for (auto& kv : view.light_tracks)
+        view.lights[kv.first]->set_position(kv.second.at(frame));
+}
+
+string output_name(string input_file, string suffix)
+{
+    vector<string> in_file_tokens = split(input_file, ".");
+    vector<string> file_tokens = split(in_file_tokens[0], "/");
+    if (in_file_tokens[in_file_tokens.size() - 1] != "txt")
+    {
+        err_msg("Input file must be a .txt file.\n");
+    }
+
+    if (mkdir("outputs", 0777) == -1 && errno != EEXIST)
+        cerr << "could not create outputs directory." << endl;
+
+    return "./outputs/" + file_tokens[file_tokens.size()-1] + suffix + ".ppm";
+}
+
+void write_ppm(string filename, int width, int height, vector<Color>& pixels)
+{
+    ofstream outf{ filename, ios_base::trunc };
+    if (!outf)
+    {
+        string msg = string("Error in creating '") +
+                        filename + "' output file.\n";
+        err_msg(msg);
+    }
+
+    outf << create_ppm_header("P3", width, height, 255);
+    put_all_normalized(outf, pixels, 255);
+}
+
+/* foo.ppm -> foo<suffix>.ppm */
+static string with_suffix(string ppm_file, string suffix)
+{
+    if (ppm_file.size() > 4 && 
+        ppm_file.substr(ppm_file.size() - 4) == ".ppm")
+        ppm_file = ppm_file.substr(0, ppm_file.size() - 4);
+    return ppm_file + suffix + ".ppm";
+}
+
+static void write_frame(string out_file, int width, int height, 
+        vector<Color>* pixels, vector<Color>* heat_pixels)
+{
+    write_ppm(out_file, width, height, *pixels);
+
+    if (heat_pixels != nullptr)
+        write_ppm(with_suffix(out_file, "_heatmap"), width, height, *heat_pixels);
+}
+
+double render_scene_file(string scene_file, string out_file, AssetCache& cache)
+{
+    vector<string> lines = read_scene_lines(scene_file);
+
+    SceneView view;
+    parse_view(lines, view);
+
+    Geometry* geo = cache.geometry(lines);
+
+    if (out_file == "") out_file = output_name(scene_file, "");
+
+    RayTracer* r = make_tracer(view, geo);
+
+    int first = view.animated ? view.first_frame : 0;
+    int last = view.animated ? view.last_frame : 0;
+
+    /* 
+        Two pixel buffers so frame N can be written out on
+         its own thread while frame N+1 is being traced, same for
+         the heatmaps. Nothing here has to be freed if a write fails.
+        Tracer, geometry and worker threads are shared by every frame.
+    */
+    vector<Color> pixels[2];
+    vector<Color> heat[2];
+    thread writer;
+    string write_error; /* only set when err_msg throws, see utils.h */
+
+    auto start = chrono::high_resolution_clock::now();
+
+    for (int f = first; f <= last; f++)
+    {
+        vector<Color>& cur = pixels[(f - first) % 2];
+        vector<Color>& cur_heat = heat[(f - first) % 2];
+
+        if (view.animated) apply_frame(view, r, f);
+
+        /* actually run the raytracer */
+        r->gen(cur);
+
+        vector<Color>* heat_pixels = nullptr;
+        if (view.heatmap_mode != HEATMAP_OFF)
+        {
+            heat_to_colors(r->get_heatmap(), cur_heat);
+            heat_pixels = &cur_heat;
+        }
+
+        string frame_file = out_file;
+        if (view.animated)
+        {
+            char num[16];
+            snprintf(num, sizeof(num), "_%04d", f);
+            frame_file = with_suffix(out_file, num);
+        }
+
+        /* the previous write has to be done before its buffer is reused */
+        if (writer.joinable()) writer.join();
+        if (write_error != "") break;
+
+        int width = view.out_width, height = view.out_height;
+        writer = thread([=, &write_error, &cur]() {
+            try
+            {
+                write_frame(frame_file, width, height, &cur, heat_pixels);
+            }
+            catch (InputError& e)
+            {
+                write_error = e.what();
+            }
+        });
+    }
+
+    if (writer.joinable()) writer.join();
+
+    if (write_error != "")
+    {
+        delete r;
+        err_msg(write_error);
+    }
+
+    auto stop = chrono::high_resolution_clock::now();
+    chrono::duration<double, milli> duration = stop - start;
+
+    delete r;
+    return duration.count();
+}
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../include/utils.h"
+#include "../include/scene.h"
+#include "../include/server.h"
+
+using namespace std;
+
+static void reply(int fd, string msg)
+{
+    msg += "\n";
+    size_t sent = 0;
+    while (sent < msg.size())
+    {
+        ssize_t n = write(fd, msg.data() + sent, msg.size() - sent);
+        if (n <= 0) return;
+        sent += n;
+    }
+}
+
+/* err_msg messages can span lines, replies can't */
+static string one_line(string msg)
+{
+    replace(msg.begin(), msg.end(), '\n', ' ');
+    while (msg.size() && msg.back() == ' ') msg.pop_back();
+    return msg;
+}
+
+/* returns false once the client should be dropped */
+static bool handle_command(string in_line, int out_fd, AssetCache& cache)
+{
+    vector<string> tokens = split(in_line, " ");
+    if (tokens.size() == 0) return true;
+
+    string keyword = tokens[0];
+
+    if (keyword == "quit")
+    {
+        reply(out_fd, "ok bye");
+        return false;
+    }
+
+    if (keyword == "stats")
+    {
+        ostringstream s;
+        s << "ok hits " << cache.hits 
+          << " misses " << cache.misses
+          << " geometries " << cache.geometry_count()
+          << " textures " << cache.texture_count();
+        reply(out_fd, s.str());
+        return true;
+    }
+
+    if (keyword == "render")
+    {
+        if (tokens.size() != 2 && tokens.size() != 3)
+        {
+            reply(out_fd, "error syntax: render <scene.txt> [output.ppm]");
+            return true;
+        }
+
+        /* 
+            Bad scene contents throw InputError instead of exiting
+             in here (serve_stream turns that on), so they just
+             get an error reply like a typo in the name does
+        */
+        struct stat st;
+        if (stat(tokens[1].c_str(), &st) == -1)
+        {
+            reply(out_fd, "error no such file " + tokens[1]);
+            return true;
+        }
+
+        string out_file = tokens.size() == 3 ? tokens[2] : "";
+        int misses = cache.misses;
+        double ms;
+        try
+        {
+            /* a name that isn't a .txt throws too */
+            if (out_file == "") out_file = output_name(tokens[1], "");
+            ms = render_scene_file(tokens[1], out_file, cache);
+        }
+        catch (InputError& e)
+        {
+            reply(out_fd, "error " + one_line(e.what()));
+            return true;
+        }
+
+        ostringstream s;
+        s << "ok " << out_file << " " << (long long)ms << "ms "
+          << (cache.misses == misses ? "hit" : "built");
+        reply(out_fd, s.str());
+        return true;
+    }
+
+    reply(out_fd, "error unknown command '" + keyword + "'");
+    return true;
+}
+
+bool serve_stream(int in_fd, int out_fd, AssetCache& cache)
+{
+    /* from here on a bad scene is the client's problem, not the server's */
+    err_msg_throws() = true;
+
+    string pending;
+    char buf[4096];
+
+    while (true)
+    {
+        size_t nl;
+        while ((nl = pending.find('\n')) != string::npos)
+        {
+            string in_line = pending.substr(0, nl);
+            pending.erase(0, nl + 1);
+
+            if (!handle_command(in_line, out_fd, cache)) return true;
+        }
+
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        pending.append(buf, n);
+    }
+
+    /* last line without a newline */
+    if (pending.size() && !handle_command(pending, out_fd, cache))
+        return true;
+
+    return false;
+}
+
+void serve_socket(string path, AssetCache& cache)
+{
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) err_msg("Could not create socket.\n");
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        err_msg("Socket path too long.\n");
+    path.copy(addr.sun_path, path.size());
+
+    unlink(path.c_str());
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+        err_msg("Could not bind socket " + path + "\n");
+    if (listen(sock, 4) == -1)
+        err_msg("Could not listen on socket " + path + "\n");
+
+    cerr << "serving on " << path << endl;
+
+    bool done = false;
+    while (!done)
+    {
+        int client = accept(sock, nullptr, nullptr);
+        if (client == -1) continue;
+
+        done = serve_stream(client, client, cache);
+        close(client);
+    }
+
+    close(sock);
+    unlink(path.c_str());
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+# Feeds the render server bad requests between good ones and checks that
+# every bad one gets an error reply and the server keeps going.
+# Run from assignment1d/ (make test does that).
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+replies=$(printf '%s\n' \
+    "render tests/tiny.txt $out/tiny.ppm" \
+    "render README.md" \
+    "render no_such_scene.txt" \
+    "render tests/bad_keyword.txt $out/bad.ppm" \
+    "render tests/tiny.txt $out/missing_dir/tiny.ppm" \
+    "render tests/tiny.txt $out/again.ppm" \
+    "stats" \
+    "quit" | ./raytracer1d --serve 2>/dev/null)
+
+expected=(
+    "^ok $out/tiny.ppm [0-9]+ms built$"
+    "^error Input file must be a .txt file.$"
+    "^error no such file no_such_scene.txt$"
+    "^error Invalid Keyword: 'notakeyword'$"
+    "^error Error in creating '$out/missing_dir/tiny.ppm' output file.$"
+    "^ok $out/again.ppm [0-9]+ms hit$"
+    "^ok hits 2 misses 1 geometries 1 textures 0$"
+    "^ok bye$"
+)
+
+failed=0
+i=0
+while IFS= read -r line; do
+    if ! [[ $line =~ ${expected[$i]} ]]; then
+        echo "reply $((i + 1)): expected /${expected[$i]}/, got '$line'"
+        failed=1
+    fi
+    i=$((i + 1))
+done <<< "$replies"
+
+if [ $i -ne ${#expected[@]} ]; then
+    echo "expected ${#expected[@]} replies, got $i (did the server die?)"
+    failed=1
+fi
+
+for f in tiny.ppm tiny_heatmap.ppm again.ppm again_heatmap.ppm; do
+    [ -s "$out/$f" ] || { echo "$f was not written"; failed=1; }
+done
+
+[ $failed -eq 0 ] && echo "server test passed"
+exit $failed
@@ -0,0 +1,199 @@
+// Spatial chunks for meshes and culling them against the view frustum.
+// No OpenGL in here, the render loop just draws the index ranges it gets back.
+
+#ifndef CULL_HPP
+#define CULL_HPP 1
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+//
+//	One node of a mesh's chunk tree, stored depth first so every
+//	subtree's triangles are one contiguous run of the index buffer.
+//	-> skip is the node right after this subtree, a leaf has skip == its index + 1
+//
+struct MeshChunk {
+	float bmin[3], bmax[3];
+	uint32_t first_index, num_indices;
+	uint32_t skip;
+};
+
+// A run of indices to draw
+struct DrawRange {
+	uint32_t first_index, num_indices;
+};
+
+//
+//	Splits the triangles into chunks of at most leaf_tris, reordering the
+//	indices so each chunk's triangles are together. Triangles keep their
+//	relative order inside a chunk, so this can run after optimize_vertex_cache.
+//	positions is num_vertices xyz triples, stride floats apart.
+//
+std::vector<MeshChunk> build_chunks( std::vector<uint32_t> &indices, const float *positions, size_t stride, uint32_t leaf_tris = 2048 );
+
+//
+//	Frustum planes pulled out of a row major clip matrix (projection * view * model),
+//	so the boxes it gets tested against are in that model's space.
+//
+class Frustum {
+public:
+	enum { OUTSIDE = 0, INTERSECTS, INSIDE };
+
+	float planes[6][4]; // ax + by + cz + d >= 0 is inside, not normalized
+
+	Frustum( const float clip[16] );
+
+	// Where the axis aligned box is compared to the frustum
+	int classify( const float bmin[3], const float bmax[3] ) const;
+};
+
+// Appends the index ranges of every chunk that might be visible,
+// neighbouring ranges get merged into one. Returns how many were added.
+size_t cull_chunks( const Frustum &frustum, const MeshChunk *chunks, size_t num_chunks, std::vector<DrawRange> &out );
+
+
+
+//
+//	Implementation
+//
+
+namespace chunking {
+
+	struct Builder {
+		std::vector<uint32_t> &indices;
+		const float *positions;
+		size_t stride;
+		uint32_t leaf_tris;
+		std::vector<uint32_t> tris; // triangle ids in their final order
+		std::vector<float> centers; // xyz per triangle
+		std::vector<MeshChunk> nodes;
+
+		Builder( std::vector<uint32_t> &indices_, const float *positions_, size_t stride_, uint32_t leaf_tris_ )
+			: indices(indices_), positions(positions_), stride(stride_), leaf_tris(std::max(leaf_tris_, 1u)) {}
+
+		const float *pos( uint32_t v ) const { return positions + size_t(v) * stride; }
+
+		void build( size_t begin, size_t end ){
+			size_t node = nodes.size();
+			nodes.push_back( MeshChunk() );
+			MeshChunk &c = nodes[node];
+			c.first_index = uint32_t(3 * begin);
+			c.num_indices = uint32_t(3 * (end - begin));
+
+			// Bounds of the triangles and of their centers, the split goes by centers
+			float cmin[3], cmax[3];
+			for( int k = 0; k < 3; ++k ){
+				c.bmin[k] = cmin[k] = INFINITY;
+				c.bmax[k] = cmax[k] = -INFINITY;
+			}
+			for( size_t i = begin; i < end; ++i ){
+				uint32_t t = tris[i];
+				for( int j = 0; j < 3; ++j ){
+					const float *p = pos( indices[3*t + j] );
+					for( int k = 0; k < 3; ++k ){
+						c.bmin[k] = std::min( c.bmin[k], p[k] );
+						c.bmax[k] = std::max( c.bmax[k], p[k] );
+					}
+				}
+				for( int k = 0; k < 3; ++k ){
+					cmin[k] = std::min( cmin[k], centers[3*t + k] );
+					cmax[k] = std::max( cmax[k], centers[3*t + k] );
+				}
+			}
+
+			if( end - begin > leaf_tris ){
+				// Halve the longest side, or just halve the list if everything lands on one side
+				int axis = 0;
+				for( int k = 1; k < 3; ++k ){ if( cmax[k] - cmin[k] > cmax[axis] - cmin[axis] ){ axis = k; } }
+				float mid = 0.5f * (cmin[axis] + cmax[axis]);
+				const std::vector<float> &cen = centers;
+				size_t split = std::stable_partition( tris.begin() + begin, tris.begin() + end,
+					[&cen, axis, mid]( uint32_t t ){ return cen[3*t + axis] < mid; } ) - tris.begin();
+				if( split == begin || split == end ){ split = begin + (end - begin) / 2; }
+
+				build( begin, split );
+				build( split, end );
+			}
+			nodes[node].skip = uint32_t( nodes.size() );
+		}
+	};
+
+} // end namespace chunking
+
+std::vector<MeshChunk> build_chunks( std::vector<uint32_t> &indices, const float *positions, size_t stride, uint32_t leaf_tris ){
+	chunking::Builder b( indices, positions, stride, leaf_tris );
+	size_t num_tris = indices.size() / 3;
+	if( num_tris == 0 ){ return b.nodes; }
+
+	b.tris.resize( num_tris );
+	b.centers.resize( 3 * num_tris );
+	for( size_t t = 0; t < num_tris; ++t ){
+		b.tris[t] = uint32_t(t);
+		for( int k = 0; k < 3; ++k ){
+			b.centers[3*t + k] = ( b.pos(indices[3*t])[k] + b.pos(indices[3*t + 1])[k] + b.pos(indices[3*t + 2])[k] ) * (1.f / 3.f);
+		}
+	}
+	b.build( 0, num_tris );
+
+	std::vector<uint32_t> reordered( indices.size() );
+	for( size_t i = 0; i < num_tris; ++i ){
+		for( int j = 0; j < 3; ++j ){ reordered[3*i + j] = indices[3*b.tris[i] + j]; }
+	}
+	indices.swap( reordered );
+	return b.nodes;
+}
+
+Frustum::Frustum( const float clip[16] ){
+	// Gribb/Hartmann: each plane is the w row plus or minus the x, y or z row
+	// (-w <= x,y,z <= w in clip space)
+	for( int p = 0; p < 6; ++p ){
+		int row = p / 2;
+		float sign = (p % 2) ? -1.f : 1.f;
+		for( int k = 0; k < 4; ++k ){ planes[p][k] = clip[12 + k] + sign * clip[4*row + k]; }
+	}
+}
+
+int Frustum::classify( const float bmin[3], const float bmax[3] ) const {
+	int result = INSIDE;
+	for( int p = 0; p < 6; ++p ){
+		const float *pl = planes[p];
+		// The box corner furthest along the plane normal, and the one furthest against it
+		float far_d = pl[3], near_d = pl[3];
+		for( int k = 0; k < 3; ++k ){
+			if( pl[k] >= 0.f ){ far_d += pl[k] * bmax[k]; near_d += pl[k] * bmin[k]; }
+			else { far_d += pl[k] * bmin[k]; near_d += pl[k] * bmax[k]; }
+		}
+		if( far_d < 0.f ){ return OUTSIDE; }
+		if( near_d < 0.f ){ result = INTERSECTS; }
+	}
+	return result;
+}
+
+size_t cull_chunks( const Frustum &frustum, const MeshChunk *chunks, size_t num_chunks, std::vector<DrawRange> &out ){
+	size_t start = out.size();
+	size_t i = 0;
+	while( i < num_chunks ){
+		const MeshChunk &c = chunks[i];
+		int in = frustum.classify( c.bmin, c.bmax );
+		bool leaf = c.skip == i + 1;
+
+		// Fully in (or a leaf that's partly in) gets drawn whole, no need to look further down
+		if( in == Frustum::INSIDE || ( in == Frustum::INTERSECTS && leaf ) ){
+			if( out.size() > start && out.back().first_index + out.back().num_indices == c.first_index ){
+				out.back().num_indices += c.num_indices;
+			}
+			else {
+				DrawRange r = { c.first_index, c.num_indices };
+				out.push_back( r );
+			}
+			i = c.skip;
+		}
+		else if( in == Frustum::OUTSIDE ){ i = c.skip; }
+		else { ++i; }
+	}
+	return out.size() - start;
+}
+
+#endif
@@ -0,0 +1,135 @@
+// Bits for running the viewer without a display: a scripted camera path,
+// per frame timings and writing frames out as images.
+
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP 1
+
+#include "trimesh.hpp"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+//
+//	Camera keyframes (eye position, yaw, pitch) spread evenly over the run,
+//	in between it's a straight line. Read from a text file, one keyframe
+//	per line: x y z yaw pitch (# starts a comment).
+//
+class CameraPath {
+public:
+	struct Key { Vec3f eye; float yaw, pitch; };
+	std::vector<Key> keys;
+
+	bool load( std::string file );
+
+	// Where the camera is on frame out of frames
+	Key sample( int frame, int frames ) const;
+};
+
+//
+//	Timings for every frame, in milliseconds. gpu is negative when
+//	the driver couldn't time it.
+//
+class FrameStats {
+public:
+	std::vector<double> cpu, gpu;
+
+	void add( double cpu_ms, double gpu_ms ){ cpu.push_back( cpu_ms ); gpu.push_back( gpu_ms ); }
+
+	// frame,cpu_ms,gpu_ms per line
+	bool write_csv( std::string file ) const;
+
+	// Average, median, 95th percentile and worst of both
+	void print_summary() const;
+};
+
+// Rows come bottom up (like glReadPixels gives them), the file is top down
+bool write_frame_ppm( std::string file, int width, int height, const unsigned char *rgb );
+
+
+
+//
+//	Implementation
+//
+
+bool CameraPath::load( std::string file ){
+	std::ifstream in( file.c_str() );
+	if( !in.is_open() ){
+		std::cerr << "\n**CameraPath Error: Could not open file " << file << std::endl;
+		return false;
+	}
+	keys.clear();
+	std::string line;
+	int line_num = 0;
+	while( std::getline( in, line ) ){
+		++line_num;
+		line = line.substr( 0, line.find( '#' ) );
+		if( line.find_first_not_of( " \t\r" ) == std::string::npos ){ continue; }
+		std::stringstream ss( line );
+		Key k;
+		if( !( ss >> k.eye[0] >> k.eye[1] >> k.eye[2] >> k.yaw >> k.pitch ) ){
+			std::cerr << "\n**CameraPath Error: line " << line_num << " of " << file << " isn't \"x y z yaw pitch\"" << std::endl;
+			return false;
+		}
+		keys.push_back( k );
+	}
+	if( keys.empty() ){
+		std::cerr << "\n**CameraPath Error: no keyframes in " << file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+CameraPath::Key CameraPath::sample( int frame, int frames ) const {
+	if( keys.size() == 1 || frames <= 1 ){ return keys[0]; }
+	float t = float(frame) / float(frames - 1) * float(keys.size() - 1);
+	size_t i = std::min( size_t(t), keys.size() - 2 );
+	float s = t - float(i);
+	const Key &a = keys[i], &b = keys[i+1];
+	Key k;
+	for( int j = 0; j < 3; ++j ){ k.eye[j] = a.eye[j] + (b.eye[j] - a.eye[j]) * s; }
+	k.yaw = a.yaw + (b.yaw - a.yaw) * s;
+	k.pitch = a.pitch + (b.pitch - a.pitch) * s;
+	return k;
+}
+
+bool FrameStats::write_csv( std::string file ) const {
+	std::ofstream out( file.c_str() );
+	if( !out.is_open() ){
+		std::cerr << "\n**FrameStats Error: Could not open file " << file << std::endl;
+		return false;
+	}
+	out << "frame,cpu_ms,gpu_ms\n";
+	for( size_t i = 0; i < cpu.size(); ++i ){ out << i << "," << cpu[i] << "," << gpu[i] << "\n"; }
+	return bool( out );
+}
+
+void FrameStats::print_summary() const {
+	auto summary = []( const char *name, std::vector<double> v ){
+		v.erase( std::remove_if( v.begin(), v.end(), []( double x ){ return x < 0.0; } ), v.end() );
+		if( v.empty() ){ std::cout << name << ": not available" << std::endl; return; }
+		std::sort( v.begin(), v.end() );
+		double sum = 0.0;
+		for( double x : v ){ sum += x; }
+		std::cout << name << " ms: avg " << sum / v.size() << ", median " << v[v.size() / 2]
+			<< ", 95% " << v[ std::min( v.size() - 1, v.size() * 95 / 100 ) ] << ", max " << v.back() << std::endl;
+	};
+	std::cout << cpu.size() << " frames" << std::endl;
+	summary( "CPU", cpu );
+	summary( "GPU", gpu );
+}
+
+bool write_frame_ppm( std::string file, int width, int height, const unsigned char *rgb ){
+	std::ofstream out( file.c_str(), std::ios::binary );
+	if( !out.is_open() ){
+		std::cerr << "\n**write_frame_ppm Error: Could not open file " << file << std::endl;
+		return false;
+	}
+	out << "P6\n" << width << " " << height << "\n255\n";
+	for( int y = height - 1; y >= 0; --y ){ out.write( (const char*)rgb + size_t(y) * width * 3, size_t(width) * 3 ); }
+	return bool( out );
+}
+
+#endif
@@ -0,0 +1,194 @@
+// Per instance transforms for drawing one mesh many times in one instanced draw.
+
+#ifndef INSTANCES_HPP
+#define INSTANCES_HPP 1
+
+#include "trimesh.hpp"
+#include "cull.hpp"
+#include <vector>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INSTANCES_SSE 1
+#endif
+
+// World space box around a box transformed by a column major matrix
+void transform_bounds( const float m[16], const float bmin[3], const float bmax[3], float wmin[3], float wmax[3] );
+
+//
+//	Rotations (euler angles, same convention set_matrix in main.cpp had) and
+//	translations of every instance, kept as one array per component so all
+//	the matrices can be rebuilt four instances at a time.
+//
+class InstanceSet {
+public:
+	std::vector<float> rx, ry, rz;
+	std::vector<float> tx, ty, tz;
+
+	// 16 floats per instance, column major, the layout the instance buffer wants
+	std::vector<float> mats;
+
+	size_t size() const { return rx.size(); }
+
+	void add( Vec3f rotation, Vec3f translate );
+
+	// Adds to every instance's rotation, angles are kept within one turn either way
+	void spin( float dx, float dy, float dz );
+
+	// Rebuilds mats from the rotations and translations
+	void update_matrices();
+
+	// Copies the matrices of the instances whose bounds (mesh space) touch the
+	// frustum (world space) into out, returns how many there were
+	size_t cull( const Frustum &frustum, const float bmin[3], const float bmax[3], std::vector<float> &out ) const;
+};
+
+
+
+//
+//	Implementation
+//
+
+void InstanceSet::add( Vec3f rotation, Vec3f translate ){
+	rx.push_back( rotation[0] ); ry.push_back( rotation[1] ); rz.push_back( rotation[2] );
+	tx.push_back( translate[0] ); ty.push_back( translate[1] ); tz.push_back( translate[2] );
+}
+
+void InstanceSet::spin( float dx, float dy, float dz ){
+	// (dropping whole turns with a truncating cast, unlike fmod this vectorizes)
+	const float two_pi = 6.28318530718f, inv_two_pi = 0.159154943092f;
+	for( size_t i = 0; i < size(); ++i ){
+		float x = rx[i] + dx, y = ry[i] + dy, z = rz[i] + dz;
+		rx[i] = x - two_pi * float( int( x * inv_two_pi ) );
+		ry[i] = y - two_pi * float( int( y * inv_two_pi ) );
+		rz[i] = z - two_pi * float( int( z * inv_two_pi ) );
+	}
+}
+
+#ifdef INSTANCES_SSE
+namespace instancing {
+
+	// sin of four angles, good to about 1e-7 anywhere an int can count the turns
+	static inline __m128 sin4( __m128 x ){
+		const __m128 sign_mask = _mm_set1_ps( -0.f );
+
+		// wrap into -pi to pi, then fold into -pi/2 to pi/2 with sin(x) = sin(pi - x)
+		__m128 turns = _mm_cvtepi32_ps( _mm_cvtps_epi32( _mm_mul_ps( x, _mm_set1_ps( 0.159154943092f ) ) ) );
+		x = _mm_sub_ps( x, _mm_mul_ps( turns, _mm_set1_ps( 6.28318530718f ) ) );
+		__m128 sign = _mm_and_ps( x, sign_mask );
+		__m128 ax = _mm_andnot_ps( sign_mask, x );
+		ax = _mm_min_ps( ax, _mm_sub_ps( _mm_set1_ps( 3.14159265359f ), ax ) );
+		x = _mm_or_ps( ax, sign );
+
+		// taylor series up to x^11
+		__m128 x2 = _mm_mul_ps( x, x );
+		__m128 p = _mm_set1_ps( -1.f / 39916800.f );
+		p = _mm_add_ps( _mm_mul_ps( p, x2 ), _mm_set1_ps( 1.f / 362880.f ) );
+		p = _mm_add_ps( _mm_mul_ps( p, x2 ), _mm_set1_ps( -1.f / 5040.f ) );
+		p = _mm_add_ps( _mm_mul_ps( p, x2 ), _mm_set1_ps( 1.f / 120.f ) );
+		p = _mm_add_ps( _mm_mul_ps( p, x2 ), _mm_set1_ps( -1.f / 6.f ) );
+		p = _mm_add_ps( _mm_mul_ps( p, x2 ), _mm_set1_ps( 1.f ) );
+		return _mm_mul_ps( p, x );
+	}
+
+	static inline __m128 cos4( __m128 x ){ return sin4( _mm_add_ps( x, _mm_set1_ps( 1.57079632679f ) ) ); }
+
+	// a*b - c*d and a*b + c*d
+	static inline __m128 mul_sub( __m128 a, __m128 b, __m128 c, __m128 d ){ return _mm_sub_ps( _mm_mul_ps( a, b ), _mm_mul_ps( c, d ) ); }
+	static inline __m128 mul_add( __m128 a, __m128 b, __m128 c, __m128 d ){ return _mm_add_ps( _mm_mul_ps( a, b ), _mm_mul_ps( c, d ) ); }
+
+} // end namespace instancing
+#endif
+
+void InstanceSet::update_matrices(){
+	size_t n = size();
+	mats.resize( 16 * n );
+	size_t i = 0;
+
+#ifdef INSTANCES_SSE
+	using namespace instancing;
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps( 1.f );
+	for( ; i + 4 <= n; i += 4 ){
+		__m128 x = _mm_loadu_ps( &rx[i] ), y = _mm_loadu_ps( &ry[i] ), z = _mm_loadu_ps( &rz[i] );
+		__m128 srx = sin4( x ), crx = cos4( x );
+		__m128 sry = sin4( y ), cry = cos4( y );
+		__m128 srz = sin4( z ), crz = cos4( z );
+		__m128 srz_srx = _mm_mul_ps( srz, srx ), crz_srx = _mm_mul_ps( crz, srx );
+
+		// Each register holds one matrix entry for four instances,
+		// transposing gives one column for each of the four
+		__m128 c0[4] = {
+			mul_sub( crz, cry, srz_srx, sry ),
+			mul_add( srz, cry, crz_srx, sry ),
+			_mm_sub_ps( zero, _mm_mul_ps( crx, sry ) ),
+			zero };
+		__m128 c1[4] = {
+			_mm_sub_ps( zero, _mm_mul_ps( srz, crx ) ),
+			_mm_mul_ps( crz, crx ),
+			srx,
+			zero };
+		__m128 c2[4] = {
+			mul_add( crz, sry, srz_srx, cry ),
+			mul_sub( srz, sry, crz_srx, cry ),
+			_mm_mul_ps( crx, cry ),
+			zero };
+		__m128 c3[4] = { _mm_loadu_ps( &tx[i] ), _mm_loadu_ps( &ty[i] ), _mm_loadu_ps( &tz[i] ), one };
+		_MM_TRANSPOSE4_PS( c0[0], c0[1], c0[2], c0[3] );
+		_MM_TRANSPOSE4_PS( c1[0], c1[1], c1[2], c1[3] );
+		_MM_TRANSPOSE4_PS( c2[0], c2[1], c2[2], c2[3] );
+		_MM_TRANSPOSE4_PS( c3[0], c3[1], c3[2], c3[3] );
+
+		for( int k = 0; k < 4; ++k ){
+			float *m = &mats[16 * (i + k)];
+			_mm_storeu_ps( m, c0[k] );
+			_mm_storeu_ps( m + 4, c1[k] );
+			_mm_storeu_ps( m + 8, c2[k] );
+			_mm_storeu_ps( m + 12, c3[k] );
+		}
+	}
+#endif
+
+	// Whatever didn't fill a group of four (or everything, without sse)
+	for( ; i < n; ++i ){
+		float crx = std::cos( rx[i] ), srx = std::sin( rx[i] );
+		float cry = std::cos( ry[i] ), sry = std::sin( ry[i] );
+		float crz = std::cos( rz[i] ), srz = std::sin( rz[i] );
+		float *m = &mats[16 * i];
+		m[0] = crz * cry - srz * srx * sry; m[4] = -srz * crx; m[8]  = crz * sry + srz * srx * cry; m[12] = tx[i];
+		m[1] = srz * cry + crz * srx * sry; m[5] = crz * crx;  m[9]  = srz * sry - crz * srx * cry; m[13] = ty[i];
+		m[2] = -crx * sry;                  m[6] = srx;        m[10] = crx * cry;                   m[14] = tz[i];
+		m[3] = 0.f;                         m[7] = 0.f;        m[11] = 0.f;                         m[15] = 1.f;
+	}
+}
+
+void transform_bounds( const float m[16], const float bmin[3], const float bmax[3], float wmin[3], float wmax[3] ){
+	float center[3], half[3];
+	for( int k = 0; k < 3; ++k ){
+		center[k] = 0.5f * (bmin[k] + bmax[k]);
+		half[k] = 0.5f * (bmax[k] - bmin[k]);
+	}
+	for( int r = 0; r < 3; ++r ){
+		float c = m[12 + r], e = 0.f;
+		for( int k = 0; k < 3; ++k ){
+			c += m[4*k + r] * center[k];
+			e += std::fabs( m[4*k + r] ) * half[k];
+		}
+		wmin[r] = c - e; wmax[r] = c + e;
+	}
+}
+
+size_t InstanceSet::cull( const Frustum &frustum, const float bmin[3], const float bmax[3], std::vector<float> &out ) const {
+	out.clear();
+	for( size_t i = 0; i < size(); ++i ){
+		const float *m = &mats[16 * i];
+		float wmin[3], wmax[3];
+		transform_bounds( m, bmin, bmax, wmin, wmax );
+		if( frustum.classify( wmin, wmax ) != Frustum::OUTSIDE ){
+			out.insert( out.end(), m, m + 16 );
+		}
+	}
+	return out.size() / 16;
+}
+
+#endif
@@ -6,68 +6,40 @@
 
 // Includes
 #include "trimesh.hpp"
+#include "vecmath.hpp"
+#include "meshcache.hpp"
+#include "cull.hpp"
+#include "instances.hpp"
+#include "headless.hpp"
 #include "shader.hpp"
 #include <cstring> // memcpy
+#include <cstddef> // offsetof
 
 #include <iostream>
 #include <math.h>
 #include <iomanip>
 #include <sstream>
+#include <chrono>
+
+/* the glad in ext/ only goes up to GL 3.1, the instance divisor is 3.3 so it's loaded by hand */
+typedef void (APIENTRYP PFNGLVERTEXATTRIBDIVISORPROC)(GLuint index, GLuint divisor);
+static PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor = NULL;
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF /* also 3.3, the query functions themselves are older */
+#endif
 
 // Constants
 #define WIN_WIDTH 1080
 #define WIN_HEIGHT 1080
 #define PI 3.14159265358979323846f  /* pi */
 
-class Mat4x4 {
-public:
-
-	float m[16];
-
-	Mat4x4(){ // Default: Identity
-		m[0] = 1.f;  m[4] = 0.f;  m[8]  = 0.f;  m[12] = 0.f;
-		m[1] = 0.f;  m[5] = 1.f;  m[9]  = 0.f;  m[13] = 0.f;
-		m[2] = 0.f;  m[6] = 0.f;  m[10] = 1.f;  m[14] = 0.f;
-		m[3] = 0.f;  m[7] = 0.f;  m[11] = 0.f;  m[15] = 1.f;
-	}
-
-	void make_identity(){
-		m[0] = 1.f;  m[4] = 0.f;  m[8]  = 0.f;  m[12] = 0.f;
-		m[1] = 0.f;  m[5] = 1.f;  m[9]  = 0.f;  m[13] = 0.f;
-		m[2] = 0.f;  m[6] = 0.f;  m[10] = 1.f;  m[14] = 0.f;
-		m[3] = 0.f;  m[7] = 0.f;  m[11] = 0.f;  m[15] = 1.f;
-	}
-
-	void print(){
-		printf(
-			"| % 6.2f % 6.2f % 6.2f % 6.2f |\n| % 6.2f % 6.2f % 6.2f % 6.2f |\n| % 6.2f % 6.2f % 6.2f % 6.2f |\n| % 6.2f % 6.2f % 6.2f % 6.2f |\n",
-			m[0], m[1], m[2], m[3],
-			m[4], m[5], m[6], m[7],
-			m[8], m[9], m[10], m[11],
-			m[12], m[13], m[14], m[15]
-		);
-	}
-
-	void make_scale(float x, float y, float z){
-		make_identity();
-		m[0] = x; m[5] = y; m[10] = z;
-	}
-};
-
-static inline const Vec3f operator*(const Mat4x4 &m, const Vec3f &v){
-	Vec3f r( m.m[0]*v[0]+m.m[4]*v[1]+m.m[8]*v[2],
-		m.m[1]*v[0]+m.m[5]*v[1]+m.m[9]*v[2],
-		m.m[2]*v[0]+m.m[6]*v[1]+m.m[10]*v[2] );
-	return r;
-}
-
-
 class Cam3d {
 public:
 	/* camera state variables */
-	Mat4x4 view, projection, rotation;
+	Mat4x4 view, projection;
+	Quat orientation; /* yaw then pitch */
 
-	Vec3f n, u, v, d, eye, up, forward, 
+	Vec3f n, u, v, eye, up, forward, 
 		  negMove, posMove, negTurn, /* x = theta, y = phi */ posTurn,
 		  up_dir, right_dir, velocity, init_up;
 
@@ -132,7 +104,7 @@ public:
 
 		/* define the viewing matrix*/
 		init_up = up_; forward = dir_; up = up_; eye = eye_;
-		update_n(); update_u(); update_v(); update_d();
+		update_n(); update_u(); update_v();
 
 		pitch = asin(-forward[1]);
 		yaw = asin(forward[0] / cos(pitch));
@@ -155,15 +127,7 @@ public:
 	}
 
 	void setup_projection()
-	{
-		/* transposed from in slides */
-		float ttn = 2 * near; 
-		float tmb = top - bottom;
-		projection.m[0]  = ttn / (right - left);            projection.m[5] = ttn / tmb; 
-		projection.m[2]  = (right + left) / (right - left); projection.m[6] = (top + bottom) / tmb;
-		projection.m[10] = -(far + near) / (far - near);    projection.m[14] = -1; 
-		projection.m[11] = -(ttn*far) / (far-near);         projection.m[15] = 0.f;
-	}
+	{ projection.make_frustum(left, right, bottom, top, near, far); }
 
 	void update_n()
 	{ n = forward; n *= -1.f; n.normalize(); }
@@ -174,27 +138,37 @@ public:
 	void update_v()
 	{ v = n.cross(u); v.normalize(); }
 
-	void update_d()
+	void setup_view()
+	{ view.make_look_at(eye, eye + forward, up); }
+
+	/* forward, right and up from yaw and pitch */
+	void apply_angles()
 	{
-		d[0] = -(eye.dot(u));
-		d[1] = -(eye.dot(v));
-		d[2] = -(eye.dot(n));
+		/* pitch around x, then yaw around y, applied to the camera's rest directions (looking down +z) */
+		orientation = Quat::axis_angle(Vec3f(0.f, 1.f, 0.f), yaw) * Quat::axis_angle(Vec3f(1.f, 0.f, 0.f), pitch);
+
+		forward = orientation.rotate(Vec3f(0.f, 0.f, 1.f));
+		right_dir = orientation.rotate(Vec3f(-1.f, 0.f, 0.f));
+		up = right_dir.cross(forward);
+
+		update_n();
+		update_u();
+		update_v();
 	}
 
-	void setup_view()
+	/* puts the camera somewhere directly (for scripted camera paths) */
+	void set_pose(Vec3f eye_, float yaw_, float pitch_)
 	{
-		view.m[0] = u[0]; view.m[4] = v[0]; view.m[8]  = n[0];
-		view.m[1] = u[1]; view.m[5] = v[1]; view.m[9]  = n[1];
-		view.m[2] = u[2]; view.m[6] = v[2]; view.m[10] = n[2];
-		view.m[3] = d[0]; view.m[7] = d[1]; view.m[11] = d[2];
+		eye = eye_; yaw = yaw_; pitch = pitch_;
+		apply_angles();
+		setup_view();
 	}
 
 	void update()
 	{ 
 		/* 
-			uses euler angles, gimbal lock possible 
-			I wanted to try quaternions but couldn't get them working
-			unfortunte!
+			turning still adds to euler angles (gimbal lock possible),
+			the orientation quaternion is rebuilt from them in apply_angles
 		*/
 		if (rotating_flags)
 		{
@@ -202,22 +176,7 @@ public:
 			yaw += mod * (negTurn[0] + posTurn[0]);
 			pitch += mod * (negTurn[1] + posTurn[1]);
 
-			/* yaw pitch roll */
-			float yup = yaw - PI * 0.5f;
-			float cospitch = cos(pitch);
-
-			forward = Vec3f(
-				cospitch * sin(yaw),
-				-sin(pitch),
-				cospitch * cos(yaw)
-			);
-
-			right_dir = Vec3f(sin(yup), 0.0f, cos(yup));
-			up = right_dir.cross(forward);
-
-			update_n();
-			update_u();
-			update_v();
+			apply_angles();
 		}
 			
 		if (moving_flags)
@@ -235,7 +194,6 @@ public:
 
 		if (moving_flags || rotating_flags)
 		{
-			update_d();
 			setup_view();
 		}
 	}
@@ -243,13 +201,15 @@ public:
 
 typedef struct GLmodel
 {
-	GLuint verts_vbo[1], colors_vbo[1], 
-		normals_vbo[1], faces_ibo[1], tris_vao;
-	std::vector<Mat4x4> model_mats;
-	std::vector<Vec3f> scales, translates;
-	std::vector<Vec3f> rotations;
-	int model_count = 1;
-	TriMesh mesh;
+	GLuint verts_vbo[1], faces_ibo[1], instance_vbo[1], tris_vao;
+	InstanceSet instances; /* one model matrix per copy of the model in the scene */
+	std::vector<float> visible_mats;
+	std::vector<float> lod_mats[MESH_MAX_LODS]; /* visible instances sorted by level of detail */
+	BakedMesh mesh;
+	/* what survived culling, refilled every draw */
+	std::vector<DrawRange> visible;
+	std::vector<GLsizei> draw_counts;
+	std::vector<const void*> draw_offsets;
 } GLmodel;
 
 //
@@ -261,6 +221,7 @@ namespace Globals {
 	GLmodel church, secret_kiwi; /* models for church and kiwi */
 	Cam3d camera; /* camera class */
 	bool kiwi_available;
+	float lod_pixels = 1.f; /* how far (in pixels) a level of detail may be off before a finer one is used */
 }
 
 //
@@ -415,34 +376,141 @@ static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 // Function to set up geometry
 void init_scene();
 
-static void set_matrix(GLmodel& mod, int model)
+/* distance from a point to a box, 0 if it's inside */
+static float distance_to_box(const Vec3f& p, const float bmin[3], const float bmax[3])
+{
+	float d2 = 0.f;
+	for (int k = 0; k < 3; k++)
+	{
+		float d = std::max(std::max(bmin[k] - p[k], p[k] - bmax[k]), 0.f);
+		d2 += d * d;
+	}
+	return sqrtf(d2);
+}
+
+/* 
+	level of detail to use for a model placed by the instance matrix model.
+	the eye is taken into the mesh's own space and measured against its tight box,
+	the instance matrices are only rotation and translation so the distance is the
+	same as in world space, without the padding a world space box picks up when rotated
+*/
+static int pick_lod(const GLmodel& mod, const Mat4x4& model)
+{
+	/* pixels covered by one unit one unit away, straight from the projection */
+	float pixels_per_unit = Globals::camera.projection.m[5] * Globals::win_height * 0.5f;
+	float distance;
+	Mat4x4 to_mesh;
+	if (model.inverse(to_mesh))
+	{
+		distance = distance_to_box(to_mesh * Globals::camera.eye, mod.mesh.bmin, mod.mesh.bmax);
+	}
+	else
+	{
+		/* squashed flat, fall back to the world space box */
+		float wmin[3], wmax[3];
+		transform_bounds(model.transposed().m, mod.mesh.bmin, mod.mesh.bmax, wmin, wmax);
+		distance = distance_to_box(Globals::camera.eye, wmin, wmax);
+	}
+	return mod.mesh.select_lod(distance, pixels_per_unit, Globals::lod_pixels);
+}
+
+/* points the instance matrix attributes (locations 3 to 6) at the instance buffer, starting at instance first */
+static void set_instance_attribs(GLmodel& mod, size_t first)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mod.instance_vbo[0]);
+	for (int c = 0; c < 4; c++)
+	{
+		glEnableVertexAttribArray(3 + c);
+		glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, 16*sizeof(float), (void*)((first*16 + c*4)*sizeof(float)));
+		glVertexAttribDivisor(3 + c, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/* 
+	for models there's only one of (like the church):
+	up close, culls the model's chunks against the camera and draws whatever is
+	left in one multi draw. further away a coarser level of detail gets drawn
+	whole, if any of it is in view. (vao and ibo need to be bound)
+*/
+static void draw_visible(GLmodel& mod)
 {
-	Mat4x4* m = &mod.model_mats[model];
-	Vec3f* r = &mod.rotations[model];
-	Vec3f* t = &mod.translates[model];
+	/* the instance matrix is column major, this wants it by rows */
+	const float* inst = mod.instances.mats.data();
+	Mat4x4 model;
+	model.load_column_major(inst);
 
-	float crz = cos((*r)[2]);
-	float srz = sin((*r)[2]);
+	Mat4x4 clip = Globals::camera.projection * Globals::camera.view * model;
+	Frustum frustum(clip.m);
 
-	float cry = cos((*r)[1]);
-	float sry = sin((*r)[1]);
+	int lod = pick_lod(mod, model);
+	if (lod > 0)
+	{
+		if (frustum.classify(mod.mesh.bmin, mod.mesh.bmax) == Frustum::OUTSIDE) return;
+		const MeshLod& l = mod.mesh.lods[lod];
+		glDrawElements(GL_TRIANGLES, GLsizei(l.num_indices), GL_UNSIGNED_INT, (void*)(size_t(l.first_index) * sizeof(uint32_t)));
+		return;
+	}
 
-	float crx = cos((*r)[0]);
-	float srx = sin((*r)[0]);
+	mod.visible.clear();
+	cull_chunks(frustum, mod.mesh.chunks, mod.mesh.num_chunks, mod.visible);
+	if (mod.visible.empty()) return;
 
-	m->m[0] = crz * cry - srz * srx * sry;
-	m->m[1] = -srz * crx;
-	m->m[2] = crz * sry + srz * srx * cry;
+	mod.draw_counts.clear(); mod.draw_offsets.clear();
+	for (const DrawRange& r : mod.visible)
+	{
+		mod.draw_counts.push_back(GLsizei(r.num_indices));
+		mod.draw_offsets.push_back((const void*)(size_t(r.first_index) * sizeof(uint32_t)));
+	}
+	glMultiDrawElements(GL_TRIANGLES, mod.draw_counts.data(), GL_UNSIGNED_INT, mod.draw_offsets.data(), GLsizei(mod.visible.size()));
+}
 
-	m->m[4] = srz * cry + crz * srx * sry;
-	m->m[5] = crz * crx;
-	m->m[6] = srz * sry - crz * srx * cry;
+/* 
+	for models with lots of copies (like the kiwis):
+	culls whole instances against the camera, sorts the ones left by level of
+	detail, uploads their matrices into the instance buffer and draws each
+	level in one go
+*/
+static void draw_instances(GLmodel& mod)
+{
+	Mat4x4 clip = Globals::camera.projection * Globals::camera.view;
+	Frustum frustum(clip.m);
 
-	m->m[8] = -crx * sry;
-	m->m[9] = srx;
-	m->m[10] = crx * cry;
+	size_t count = mod.instances.cull(frustum, mod.mesh.bmin, mod.mesh.bmax, mod.visible_mats);
+	if (count == 0) return;
 
-	m->m[3] = (*t)[0]; m->m[7] = (*t)[1]; m->m[11] = (*t)[2];
+	for (int l = 0; l < MESH_MAX_LODS; l++) mod.lod_mats[l].clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		const float* m = &mod.visible_mats[16 * i];
+		Mat4x4 model;
+		model.load_column_major(m);
+		int lod = pick_lod(mod, model);
+		mod.lod_mats[lod].insert(mod.lod_mats[lod].end(), m, m + 16);
+	}
+
+	/* orphan the old buffer rather than wait for the last frame to be done with it */
+	glBindBuffer(GL_ARRAY_BUFFER, mod.instance_vbo[0]);
+	glBufferData(GL_ARRAY_BUFFER, mod.instances.mats.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+	size_t offset = 0;
+	for (int l = 0; l < MESH_MAX_LODS; l++)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(float), mod.lod_mats[l].size() * sizeof(float), mod.lod_mats[l].data());
+		offset += mod.lod_mats[l].size();
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	/* no base instance in GL 3.3, so the attributes get pointed at each level's matrices instead */
+	size_t first = 0;
+	for (size_t l = 0; l < mod.mesh.num_lods; l++)
+	{
+		size_t n = mod.lod_mats[l].size() / 16;
+		if (n == 0) continue;
+		set_instance_attribs(mod, first);
+		const MeshLod& lod = mod.mesh.lods[l];
+		glDrawElementsInstanced(GL_TRIANGLES, GLsizei(lod.num_indices), GL_UNSIGNED_INT, (void*)(size_t(lod.first_index) * sizeof(uint32_t)), GLsizei(n));
+		first += n;
+	}
 }
 
 void update()
@@ -451,12 +519,128 @@ void update()
 
 	if (Globals::kiwi_available)
 	{
-		for (int i = 0; i < Globals::secret_kiwi.model_count; i++)
+		/* all of them at once, see instances.hpp */
+		Globals::secret_kiwi.instances.spin(0.f, 0.01f, 0.f);
+		Globals::secret_kiwi.instances.update_matrices();
+	}
+}
+
+/* clears and draws one frame, doesn't swap */
+static void render_frame(mcl::Shader& shader)
+{
+	// Clear the color and depth buffers
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	update();
+
+	// Send updated info to the GPU
+	glUniformMatrix4fv(shader.uniform("projection"), 1, GL_TRUE, Globals::camera.projection.m); // projection matrix
+	glUniformMatrix4fv(shader.uniform("view"), 1, GL_TRUE, Globals::camera.view.m); // viewing transformation
+
+	/* draw church */
+	glBindVertexArray(Globals::church.tris_vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Globals::church.faces_ibo[0]);
+	draw_visible(Globals::church); // model transformation (always the identity matrix in this assignment)
+
+	/* draw kiwi */
+	if (Globals::kiwi_available)
+	{
+		glBindVertexArray(Globals::secret_kiwi.tris_vao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Globals::secret_kiwi.faces_ibo[0]);
+		draw_instances(Globals::secret_kiwi);
+	}
+}
+
+/* command line options for running without a display */
+struct HeadlessOptions {
+	int frames = 0; /* 0 means the normal interactive window */
+	std::string path_file, timings_file, dump_prefix;
+};
+
+/* 
+	plays the camera path over opts.frames frames as fast as it can,
+	timing each one and optionally saving them as images
+*/
+static int run_headless(GLFWwindow* window, mcl::Shader& shader, const HeadlessOptions& opts)
+{
+	CameraPath path;
+	if (!opts.path_file.empty())
+	{
+		if (!path.load(opts.path_file)) return EXIT_FAILURE;
+	}
+	else
+	{
+		/* no path given: one full turn on the spot */
+		CameraPath::Key start = { Globals::camera.eye, Globals::camera.yaw, Globals::camera.pitch };
+		CameraPath::Key end = start; end.yaw += 2.f * PI;
+		path.keys.push_back(start);
+		path.keys.push_back(end);
+	}
+
+	/* gpu timer queries, read back once everything is done so they never stall a frame */
+	GLint timer_bits = 0;
+	glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &timer_bits);
+	glGetError(); /* in case the driver doesn't know about timer queries at all */
+	std::vector<GLuint> queries(opts.frames, 0);
+	if (timer_bits > 0) glGenQueries(opts.frames, queries.data());
+	else std::cout << "**Warning: no GPU timer queries, only CPU times will be recorded" << std::endl;
+
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	std::vector<unsigned char> pixels(size_t(width) * height * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	std::vector<double> cpu_ms(opts.frames);
+	for (int f = 0; f < opts.frames; f++)
+	{
+		CameraPath::Key key = path.sample(f, opts.frames);
+		Globals::camera.set_pose(key.eye, key.yaw, key.pitch);
+
+		/* cpu time is everything up to having handed the frame to the driver */
+		auto start = std::chrono::steady_clock::now();
+		if (timer_bits > 0) glBeginQuery(GL_TIME_ELAPSED, queries[f]);
+		render_frame(shader);
+		if (timer_bits > 0) glEndQuery(GL_TIME_ELAPSED);
+		cpu_ms[f] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (!opts.dump_prefix.empty())
 		{
-			Globals::secret_kiwi.rotations[i][1] += 0.01;
-			set_matrix(Globals::secret_kiwi, i);
+			glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+			std::stringstream file; file << opts.dump_prefix << std::setw(4) << std::setfill('0') << f << ".ppm";
+			if (!write_frame_ppm(file.str(), width, height, pixels.data())) return EXIT_FAILURE;
 		}
+
+		glfwSwapBuffers(window);
+		glfwPollEvents();
 	}
+	glFinish();
+
+	FrameStats stats;
+	for (int f = 0; f < opts.frames; f++)
+	{
+		double gpu_ms = -1.0;
+		if (timer_bits > 0)
+		{
+			GLuint ns = 0;
+			glGetQueryObjectuiv(queries[f], GL_QUERY_RESULT, &ns);
+			gpu_ms = ns * 1e-6;
+		}
+		stats.add(cpu_ms[f], gpu_ms);
+	}
+	if (timer_bits > 0) glDeleteQueries(opts.frames, queries.data());
+
+	stats.print_summary();
+	if (!opts.timings_file.empty() && !stats.write_csv(opts.timings_file)) return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+static void print_usage(const char* name)
+{
+	std::cout << "usage: " << name << " [--headless <frames> [--path <file>] [--timings <file.csv>] [--dump <prefix>]]\n"
+		<< "  --headless  render <frames> frames without showing a window and print how long they took\n"
+		<< "  --path      camera keyframes, one \"x y z yaw pitch\" per line (default: one turn on the spot)\n"
+		<< "  --timings   write every frame's cpu/gpu time to a csv file\n"
+		<< "  --dump      save every frame as <prefix>0000.ppm, <prefix>0001.ppm, ..." << std::endl;
 }
 
 //
@@ -464,15 +648,32 @@ void update()
 //
 int main(int argc, char *argv[]){
 
+	HeadlessOptions headless;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--headless" && has_value) headless.frames = atoi(argv[++i]);
+		else if (arg == "--path" && has_value) headless.path_file = argv[++i];
+		else if (arg == "--timings" && has_value) headless.timings_file = argv[++i];
+		else if (arg == "--dump" && has_value) headless.dump_prefix = argv[++i];
+		else { print_usage(argv[0]); return EXIT_FAILURE; }
+	}
+	if (headless.frames < 0 || (headless.frames == 0 && (!headless.path_file.empty() || !headless.timings_file.empty() || !headless.dump_prefix.empty())))
+	{
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
 	// Load the mesh
 	std::stringstream obj_file; obj_file << MY_DATA_DIR << "sibenik/sibenik.obj";
 	std::stringstream kiwi_file; kiwi_file << MY_DATA_DIR << "biwer/kiwi1.obj";
 
-	if( !Globals::church.mesh.load_obj(obj_file.str())){ return EXIT_FAILURE; }
+	if( !load_mesh(obj_file.str(), Globals::church.mesh)){ return EXIT_FAILURE; }
 	Globals::church.mesh.print_details();
 
 	Globals::kiwi_available = true;
-	if (!Globals::secret_kiwi.mesh.load_obj(kiwi_file.str())) { 
+	if (!load_mesh(kiwi_file.str(), Globals::secret_kiwi.mesh)) { 
 		Globals::kiwi_available = false; 
 		std::cout << "The church is safe..." << std::endl;
 	}
@@ -486,16 +687,10 @@ int main(int argc, char *argv[]){
     	// This code should eventually be replaced by the use of an appropriate projection matrix
     	// FYI: the model dimensions are: center = (0,0,0); height: 30.6; length: 40.3; width: 17.0
     // find the extremum of the vertex locations (this approach works because the model is known to be centered; a more complicated method would be required in the general case)
+    // (the bounds come with the mesh now, worked out when it was baked)
     Vec3f min, max, scale;
-    min = Globals::church.mesh.vertices[0]; max = Globals::church.mesh.vertices[0];
-	for( int i=0; i<Globals::church.mesh.vertices.size(); ++i ){
-           if (Globals::church.mesh.vertices[i][0] < min[0]) min[0] = Globals::church.mesh.vertices[i][0];
-           else if (Globals::church.mesh.vertices[i][0] > max[0]) max[0] = Globals::church.mesh.vertices[i][0];
-           if (Globals::church.mesh.vertices[i][1] < min[1]) min[1] = Globals::church.mesh.vertices[i][1];
-           else if (Globals::church.mesh.vertices[i][1] > max[1]) max[1] = Globals::church.mesh.vertices[i][1];
-           if (Globals::church.mesh.vertices[i][2] < min[2]) min[2] = Globals::church.mesh.vertices[i][2];
-           else if (Globals::church.mesh.vertices[i][2] > max[2]) max[2] = Globals::church.mesh.vertices[i][2];
-    }
+    min = Vec3f(Globals::church.mesh.bmin[0], Globals::church.mesh.bmin[1], Globals::church.mesh.bmin[2]);
+    max = Vec3f(Globals::church.mesh.bmax[0], Globals::church.mesh.bmax[1], Globals::church.mesh.bmax[2]);
     // work with positive numbers
     /*if (min < 0) min = -min;*/
     // scale so that the component that is most different from 0 is mapped to 1 (or -1); all other values will then by definition fall between -1 and 1
@@ -539,6 +734,10 @@ int main(int argc, char *argv[]){
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
+	// Headless runs never show the window (and with GLFW built with
+	// -DGLFW_USE_OSMESA=ON there's no window at all, just an OSMesa buffer)
+	if (headless.frames > 0) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
 	// Create the glfw window
 	Globals::win_width = WIN_WIDTH;
 	Globals::win_height = WIN_HEIGHT;
@@ -551,7 +750,7 @@ int main(int argc, char *argv[]){
 
 	// More setup stuff
 	glfwMakeContextCurrent(window); // Make the window current
-    glfwSwapInterval(1); // Set the swap interval
+    glfwSwapInterval(headless.frames > 0 ? 0 : 1); // Set the swap interval, headless runs don't wait for vsync
 
 	// make sure the openGL and GLFW code can be found
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
@@ -559,6 +758,12 @@ int main(int argc, char *argv[]){
 		glfwTerminate();
 		return EXIT_FAILURE;
 	}
+	glVertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)glfwGetProcAddress("glVertexAttribDivisor");
+	if (!glVertexAttribDivisor) {
+		std::cout << "Failed to load glVertexAttribDivisor (needs OpenGL 3.3)" << std::endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
 
 	// Initialize the shaders
 	// MY_SRC_DIR was defined in CMakeLists.txt
@@ -567,25 +772,24 @@ int main(int argc, char *argv[]){
 	std::stringstream ss; ss << MY_SRC_DIR << "shader.";
 	shader.init_from_files( ss.str()+"vert", ss.str()+"frag" );
 
-	// Initialize the scene
-	init_scene();
-
-
 	if (Globals::kiwi_available)
 	{
-		Globals::secret_kiwi.translates.push_back(Vec3f(
+		/* all upside down (rotated by pi around z), the spin comes in update() */
+		Vec3f flip(0.f, 0.f, PI);
+
+		Globals::secret_kiwi.instances.add(flip, Vec3f(
 			min[0] + 3.f,
 			min[1] + 0.8f,
 			min[2] + (max[2] - min[2]) * 0.5f
 		));
 
-		Globals::secret_kiwi.translates.push_back(Vec3f(
+		Globals::secret_kiwi.instances.add(flip, Vec3f(
 			min[0] + 3.f,
 			min[1] + 0.8f,
 			min[2] + (max[2] - min[2]) * 0.5f + 2.f
 		));
 
-		Globals::secret_kiwi.translates.push_back(Vec3f(
+		Globals::secret_kiwi.instances.add(flip, Vec3f(
 			min[0] + 3.f,
 			min[1] + 0.8f,
 			min[2] + (max[2] - min[2]) * 0.5f - 2.f
@@ -593,13 +797,14 @@ int main(int argc, char *argv[]){
 
 		/* 10 -12 -2 */
 
-		Globals::secret_kiwi.translates.push_back(Vec3f(10.5, -13, -2));
+		Globals::secret_kiwi.instances.add(flip, Vec3f(10.5, -13, -2));
 
-		Globals::secret_kiwi.translates.push_back(Vec3f(10.5, -13, 2));
-
-		set_matrix(Globals::secret_kiwi, 0);
+		Globals::secret_kiwi.instances.add(flip, Vec3f(10.5, -13, 2));
 	}
 
+	// Initialize the scene
+	init_scene();
+
 	framebuffer_size_callback(window, int(Globals::win_width), int(Globals::win_height)); 
 
 	// Perform some OpenGL initializations
@@ -611,36 +816,13 @@ int main(int argc, char *argv[]){
 
 	// Bind buffers
 
-	// Game loop
-	while(!glfwWindowShouldClose(window)){
-
-		// Clear the color and depth buffers
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		update();
-
-		// Send updated info to the GPU
-		glUniformMatrix4fv(shader.uniform("projection"), 1, GL_TRUE, Globals::camera.projection.m); // projection matrix
-		glUniformMatrix4fv(shader.uniform("view"), 1, GL_TRUE, Globals::camera.view.m); // viewing transformation
+	int result = EXIT_SUCCESS;
+	if (headless.frames > 0) result = run_headless(window, shader, headless);
 
-		/* draw church */
-		glBindVertexArray(Globals::church.tris_vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Globals::church.faces_ibo[0]);
-		glUniformMatrix4fv(shader.uniform("model"), 1, GL_FALSE, Globals::church.model_mats[0].m); // model transformation (always the identity matrix in this assignment)
-		glDrawElements(GL_TRIANGLES, Globals::church.mesh.faces.size()*3, GL_UNSIGNED_INT, 0);
+	// Game loop
+	while(headless.frames == 0 && !glfwWindowShouldClose(window)){
 
-		/* draw kiwi */
-		if (Globals::kiwi_available)
-		{
-			glBindVertexArray(Globals::secret_kiwi.tris_vao);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Globals::secret_kiwi.faces_ibo[0]);
-			for (int i = 0; i < Globals::secret_kiwi.model_count; i++)
-			{
-				glUniformMatrix4fv(shader.uniform("model"), 1, GL_TRUE, Globals::secret_kiwi.model_mats[i].m); // model transformation (always the identity matrix in this assignment)
-				glDrawElements(GL_TRIANGLES, Globals::secret_kiwi.mesh.faces.size() * 3, GL_UNSIGNED_INT, 0);
-			}
-		}
-		
+		render_frame(shader);
 
 		// Finalize
 		glfwSwapBuffers(window);
@@ -655,73 +837,69 @@ int main(int argc, char *argv[]){
 	// Disable the shader, we're done using it
 	shader.disable();
     
-	return EXIT_SUCCESS;
+	return result;
 }
 
 void init_buffers(GLmodel& model)
 {
 	int vert_dim = 3;
+	GLsizei stride = sizeof(MeshVertex);
 
-	// Create the buffer for vertices
+	// Create the buffer for vertices, position/normal/color all in one
+	// (the mesh is already laid out like this, straight from the cache file)
 	glGenBuffers(1, model.verts_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, model.verts_vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER, model.mesh.vertices.size()*sizeof(model.mesh.vertices[0]), &model.mesh.vertices[0][0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Create the buffer for colors
-	glGenBuffers(1, model.colors_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, model.colors_vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER, model.mesh.colors.size()*sizeof(model.mesh.colors[0]), &model.mesh.colors[0][0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Create the buffer for normals
-	glGenBuffers(1, model.normals_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, model.normals_vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER, model.mesh.normals.size()*sizeof(model.mesh.normals[0]), &model.mesh.normals[0][0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, model.mesh.num_vertices*sizeof(MeshVertex), model.mesh.vertices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	// Create the buffer for indices
 	glGenBuffers(1, model.faces_ibo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.faces_ibo[0]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.mesh.faces.size()*sizeof(model.mesh.faces[0]), &model.mesh.faces[0][0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.mesh.num_indices*sizeof(uint32_t), model.mesh.indices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	// Create the VAO
 	glGenVertexArrays(1, &model.tris_vao);
 	glBindVertexArray(model.tris_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, model.verts_vbo[0]);
 
 	// location=0 is the vertex
 	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, model.verts_vbo[0]);
-	glVertexAttribPointer(0, vert_dim, GL_FLOAT, GL_FALSE, sizeof(model.mesh.vertices[0]), 0);
+	glVertexAttribPointer(0, vert_dim, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(MeshVertex, pos));
 
-	// location=1 is the color
+	// location=1 is the color, bytes that come out as 0-1
 	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, model.colors_vbo[0]);
-	glVertexAttribPointer(1, vert_dim, GL_FLOAT, GL_FALSE, sizeof(model.mesh.colors[0]), 0);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(MeshVertex, color));
 
-	// location=2 is the normal
+	// location=2 is the normal, octahedral shorts that come out as -1 to 1
 	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, model.normals_vbo[0]);
-	glVertexAttribPointer(2, vert_dim, GL_FLOAT, GL_FALSE, sizeof(model.mesh.normals[0]), 0);
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(MeshVertex, normal));
+
+	// Create the buffer for per instance model matrices
+	glGenBuffers(1, model.instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, model.instance_vbo[0]);
+	glBufferData(GL_ARRAY_BUFFER, model.instances.mats.size()*sizeof(float), model.instances.mats.data(), GL_STREAM_DRAW);
+
+	// location=3 to 6 are the model matrix columns, one matrix per instance
+	// (draws that aren't instanced just get the first one)
+	set_instance_attribs(model, 0);
 
 	// Done setting data for the vao
 	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void init_scene(){
+	/* the church is just the one, right where it was modeled */
+	Globals::church.instances.add(Vec3f(0.f, 0.f, 0.f), Vec3f(0.f, 0.f, 0.f));
+	Globals::church.instances.update_matrices();
 	init_buffers(Globals::church);
-	Globals::church.model_mats.push_back(Mat4x4());
 
 	if (Globals::kiwi_available)
 	{
+		/* placed in main() */
+		Globals::secret_kiwi.instances.update_matrices();
 		init_buffers(Globals::secret_kiwi);
-		Globals::secret_kiwi.model_count = 5;
-		for (int i = 0; i < Globals::secret_kiwi.model_count; i++)
-		{
-			Globals::secret_kiwi.model_mats.push_back(Mat4x4());
-			Globals::secret_kiwi.rotations.push_back(Vec3f(0.f, 0.f, PI));
-		}
 	}
 }
 
@@ -0,0 +1,310 @@
+// Binary cache for loaded meshes, so the OBJ text only gets parsed once.
+
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP 1
+
+#include "trimesh.hpp"
+#include "meshopt.hpp"
+#include "cull.hpp"
+#include "simplify.hpp"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//
+//	One vertex the way the VBO stores it, interleaved, 20 bytes
+//	-> normal is octahedral encoded into two snorm16s,
+//		shader.vert turns it back into a vec3
+//	-> color is rgba8, alpha is always 255
+//
+struct MeshVertex {
+	float pos[3];
+	int16_t normal[2];
+	uint8_t color[4];
+};
+static_assert( sizeof(MeshVertex) == 20, "MeshVertex should pack to 20 bytes" );
+
+// Unit normal to octahedral coords, see shader.vert for the way back
+// (Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors")
+static inline void oct_encode( const Vec3f &n, int16_t out[2] ){
+	float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+	float x = 0.f, y = 0.f;
+	if( l1 > 0.f ){
+		x = n[0] / l1; y = n[1] / l1;
+		// bottom half folds over the diagonals
+		if( n[2] < 0.f ){
+			float fx = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+			float fy = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+			x = fx; y = fy;
+		}
+	}
+	out[0] = (int16_t)std::lround( std::max(-1.f, std::min(1.f, x)) * 32767.f );
+	out[1] = (int16_t)std::lround( std::max(-1.f, std::min(1.f, y)) * 32767.f );
+}
+
+//
+//	One level of detail: a run of the index buffer drawing the whole mesh,
+//	and about how far (model units) it strays from the full detail one.
+//	Level 0 is the full mesh, each one after has about half the triangles.
+//
+struct MeshLod {
+	uint32_t first_index, num_indices;
+	float error;
+};
+
+static const int MESH_MAX_LODS = 4;
+
+static inline uint8_t unorm8( float v ){
+	return (uint8_t)std::lround( std::max(0.f, std::min(1.f, v)) * 255.f );
+}
+
+//
+//	A mesh in the layout the GPU gets it: one interleaved vertex
+//	array, one index array (three per triangle, every level of detail
+//	one after the other), the bounds, the levels of detail and the
+//	chunk tree for culling level 0 (see cull.hpp).
+//	Either mapped straight from a cache file or baked from a TriMesh,
+//	the pointers are valid as long as the BakedMesh is.
+//
+class BakedMesh {
+public:
+	const MeshVertex *vertices = nullptr;
+	const uint32_t *indices = nullptr;
+	const MeshChunk *chunks = nullptr;
+	const MeshLod *lods = nullptr;
+	size_t num_vertices = 0, num_indices = 0, num_chunks = 0, num_lods = 0;
+	float bmin[3] = {0, 0, 0}, bmax[3] = {0, 0, 0};
+
+	BakedMesh(){}
+	BakedMesh(const BakedMesh&) = delete;
+	BakedMesh& operator=(const BakedMesh&) = delete;
+
+	// Copies the mesh into the interleaved layout, with triangles and
+	// vertices reordered for the vertex cache (see meshopt.hpp) and
+	// grouped into chunks, plus the simplified levels of detail
+	void bake( const TriMesh &mesh );
+
+	// The coarsest level whose error, seen from distance away, stays under
+	// max_pixels on screen. pixels_per_unit is how many pixels something one
+	// unit big covers at distance 1.
+	int select_lod( float distance, float pixels_per_unit, float max_pixels ) const;
+
+	// Cache file io, false if it can't be written / isn't a usable cache
+	bool write( std::string file, uint64_t src_size, int64_t src_mtime ) const;
+	bool read( std::string file, uint64_t src_size, int64_t src_mtime );
+
+	// Prints details about the mesh
+	void print_details() const;
+
+private:
+	MappedFile mapped;
+	std::vector<MeshVertex> own_vertices;
+	std::vector<uint32_t> own_indices;
+	std::vector<MeshChunk> own_chunks;
+	std::vector<MeshLod> own_lods;
+};
+
+//
+//	Loads <obj_file>.cache if it was made from this exact obj file
+//	(same size and modification time) by this version of the code.
+//	Otherwise parses the obj and writes the cache for next time.
+//
+bool load_mesh( std::string obj_file, BakedMesh &out );
+
+
+
+//
+//	Implementation
+//
+
+// Bump whenever the layout changes, old caches then get rebuilt
+static const uint32_t MESH_CACHE_VERSION = 5;
+
+// Fixed size so the arrays after it stay aligned
+struct MeshCacheHeader {
+	char magic[8];          // "HW2BMESH"
+	uint32_t version;
+	uint32_t byte_order;    // 0x01020304 as written, catches caches from another endianness
+	uint64_t src_size;
+	int64_t src_mtime;
+	uint64_t num_vertices;
+	uint64_t num_indices;
+	uint64_t num_chunks;
+	uint64_t num_lods;
+	float bmin[3], bmax[3];
+};
+
+void BakedMesh::bake( const TriMesh &mesh ){
+	own_indices.resize( mesh.faces.size() * 3 );
+	for( size_t f = 0; f < mesh.faces.size(); ++f ){
+		for( int k = 0; k < 3; ++k ){ own_indices[3*f + k] = mesh.faces[f][k]; }
+	}
+
+	size_t nv = mesh.vertices.size();
+	VertexCacheStats before = analyze_vertex_cache( own_indices, nv );
+	const float *positions = nv ? mesh.vertices[0].data : nullptr;
+	optimize_vertex_cache( own_indices, nv );
+	own_chunks = build_chunks( own_indices, positions, 3 );
+
+	// Each level is simplified from the one before, so the errors add up
+	own_lods.clear();
+	MeshLod full = { 0, uint32_t( own_indices.size() ), 0.f };
+	own_lods.push_back( full );
+	std::vector<uint32_t> level( own_indices );
+	while( own_lods.size() < (size_t)MESH_MAX_LODS ){
+		float err = 0.f;
+		std::vector<uint32_t> next = simplify( level, positions, 3, nv, level.size() / 6 * 3, err );
+		if( next.empty() || next.size() > level.size() * 3 / 4 ){ break; } // not worth another level
+		optimize_vertex_cache( next, nv );
+		MeshLod lod = { uint32_t( own_indices.size() ), uint32_t( next.size() ), own_lods.back().error + err };
+		own_lods.push_back( lod );
+		own_indices.insert( own_indices.end(), next.begin(), next.end() );
+		level.swap( next );
+	}
+
+	std::vector<uint32_t> remap = optimize_vertex_fetch( own_indices, nv );
+	std::vector<uint32_t> lod0( own_indices.begin(), own_indices.begin() + own_lods[0].num_indices );
+	VertexCacheStats after = analyze_vertex_cache( lod0, nv );
+	std::cout << "Vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+		<< ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+
+	own_vertices.resize( nv );
+	for( size_t i = 0; i < nv; ++i ){
+		MeshVertex &v = own_vertices[i];
+		size_t src = remap[i];
+		for( int k = 0; k < 3; ++k ){
+			v.pos[k] = mesh.vertices[src][k];
+			v.color[k] = unorm8( mesh.colors[src][k] );
+		}
+		v.color[3] = 255;
+		oct_encode( mesh.normals[src], v.normal );
+	}
+
+	for( int k = 0; k < 3; ++k ){
+		bmin[k] = own_vertices.size() ? own_vertices[0].pos[k] : 0.f;
+		bmax[k] = bmin[k];
+	}
+	for( const MeshVertex &v : own_vertices ){
+		for( int k = 0; k < 3; ++k ){
+			bmin[k] = std::min( bmin[k], v.pos[k] );
+			bmax[k] = std::max( bmax[k], v.pos[k] );
+		}
+	}
+
+	vertices = own_vertices.data(); num_vertices = own_vertices.size();
+	indices = own_indices.data(); num_indices = own_indices.size();
+	chunks = own_chunks.data(); num_chunks = own_chunks.size();
+	lods = own_lods.data(); num_lods = own_lods.size();
+}
+
+int BakedMesh::select_lod( float distance, float pixels_per_unit, float max_pixels ) const {
+	int lod = 0;
+	for( size_t i = 1; i < num_lods; ++i ){
+		if( lods[i].error * pixels_per_unit > max_pixels * distance ){ break; }
+		lod = int(i);
+	}
+	return lod;
+}
+
+bool BakedMesh::write( std::string file, uint64_t src_size, int64_t src_mtime ) const {
+	MeshCacheHeader h;
+	std::memset( &h, 0, sizeof(h) );
+	std::memcpy( h.magic, "HW2BMESH", 8 );
+	h.version = MESH_CACHE_VERSION;
+	h.byte_order = 0x01020304;
+	h.src_size = src_size; h.src_mtime = src_mtime;
+	h.num_vertices = num_vertices; h.num_indices = num_indices; h.num_chunks = num_chunks; h.num_lods = num_lods;
+	for( int k = 0; k < 3; ++k ){ h.bmin[k] = bmin[k]; h.bmax[k] = bmax[k]; }
+
+	// Written to a temp file first so a half written cache is never picked up
+	std::string tmp = file + ".tmp";
+	std::ofstream out( tmp.c_str(), std::ios::binary | std::ios::trunc );
+	if( !out.is_open() ){ return false; }
+	out.write( (const char*)&h, sizeof(h) );
+	out.write( (const char*)vertices, num_vertices * sizeof(MeshVertex) );
+	out.write( (const char*)indices, num_indices * sizeof(uint32_t) );
+	out.write( (const char*)chunks, num_chunks * sizeof(MeshChunk) );
+	out.write( (const char*)lods, num_lods * sizeof(MeshLod) );
+	out.close();
+	if( !out ){ std::remove( tmp.c_str() ); return false; }
+
+	std::remove( file.c_str() ); // rename won't replace on windows
+	return std::rename( tmp.c_str(), file.c_str() ) == 0;
+}
+
+bool BakedMesh::read( std::string file, uint64_t src_size, int64_t src_mtime ){
+	if( !mapped.open( file ) ){ return false; }
+	if( mapped.size < sizeof(MeshCacheHeader) ){ mapped.close(); return false; }
+
+	MeshCacheHeader h;
+	std::memcpy( &h, mapped.data, sizeof(h) );
+	size_t expected = sizeof(h) + h.num_vertices * sizeof(MeshVertex) + h.num_indices * sizeof(uint32_t)
+		+ h.num_chunks * sizeof(MeshChunk) + h.num_lods * sizeof(MeshLod);
+	if( std::memcmp( h.magic, "HW2BMESH", 8 ) != 0 || h.version != MESH_CACHE_VERSION
+		|| h.byte_order != 0x01020304 || h.src_size != src_size || h.src_mtime != src_mtime
+		|| h.num_lods == 0 || mapped.size != expected ){
+		mapped.close();
+		return false;
+	}
+
+	num_vertices = h.num_vertices; num_indices = h.num_indices; num_chunks = h.num_chunks; num_lods = h.num_lods;
+	vertices = (const MeshVertex*)(mapped.data + sizeof(h));
+	indices = (const uint32_t*)(mapped.data + sizeof(h) + num_vertices * sizeof(MeshVertex));
+	chunks = (const MeshChunk*)(indices + num_indices);
+	lods = (const MeshLod*)(chunks + num_chunks);
+	for( int k = 0; k < 3; ++k ){ bmin[k] = h.bmin[k]; bmax[k] = h.bmax[k]; }
+	return true;
+}
+
+void BakedMesh::print_details() const {
+	std::cout << "Vertices: " << num_vertices << std::endl;
+	std::cout << "Faces: " << (num_lods ? lods[0].num_indices : num_indices) / 3 << std::endl;
+	for( size_t i = 1; i < num_lods; ++i ){
+		std::cout << "LOD " << i << ": " << lods[i].num_indices / 3 << " faces, error " << lods[i].error << std::endl;
+	}
+	std::cout << "Chunk tree nodes: " << num_chunks << std::endl;
+	std::cout << "Bounds: (" << bmin[0] << ", " << bmin[1] << ", " << bmin[2] << ") to ("
+		<< bmax[0] << ", " << bmax[1] << ", " << bmax[2] << ")" << std::endl;
+}
+
+// Size and modification time of a file, false if it isn't there
+static bool file_stamp( const std::string &file, uint64_t &size, int64_t &mtime ){
+#ifndef _WIN32
+	struct stat st;
+	if( stat( file.c_str(), &st ) != 0 ){ return false; }
+#else
+	struct _stat64 st;
+	if( _stat64( file.c_str(), &st ) != 0 ){ return false; }
+#endif
+	size = st.st_size; mtime = st.st_mtime;
+	return true;
+}
+
+bool load_mesh( std::string obj_file, BakedMesh &out ){
+	std::string cache_file = obj_file + ".cache";
+
+	uint64_t size = 0; int64_t mtime = 0;
+	if( !file_stamp( obj_file, size, mtime ) ){
+		std::cerr << "\n**load_mesh Error: Could not open file " << obj_file << std::endl;
+		return false;
+	}
+
+	if( out.read( cache_file, size, mtime ) ){
+		std::cout << "\nLoaded " << cache_file << std::endl;
+		return true;
+	}
+
+	TriMesh mesh;
+	if( !mesh.load_obj( obj_file ) ){ return false; }
+	mesh.need_colors();
+	out.bake( mesh );
+
+	if( !out.write( cache_file, size, mtime ) ){
+		std::cout << "**Warning: couldn't write " << cache_file << ", the obj will be parsed again next time" << std::endl;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,195 @@
+// Index/vertex reordering so the GPU does less vertex work per triangle.
+
+#ifndef MESHOPT_HPP
+#define MESHOPT_HPP 1
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+//
+//	How well an index buffer uses the post-transform vertex cache
+//	-> acmr: vertices shaded per triangle (0.5 is the best possible, 3 the worst)
+//	-> atvr: vertices shaded per unique vertex (1 is the best possible)
+//
+struct VertexCacheStats {
+	float acmr = 0.f, atvr = 0.f;
+};
+
+// Simulates a fifo cache of cache_size entries over the indices
+VertexCacheStats analyze_vertex_cache( const std::vector<uint32_t> &indices, size_t num_vertices, int cache_size = 16 );
+
+// Reorders the triangles (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation")
+void optimize_vertex_cache( std::vector<uint32_t> &indices, size_t num_vertices );
+
+// Renumbers vertices in the order the indices first use them, and rewrites the
+// indices to match. Returns remap, where new vertex remap[i] is old vertex i.
+// (vertices nothing points at go at the end)
+std::vector<uint32_t> optimize_vertex_fetch( std::vector<uint32_t> &indices, size_t num_vertices );
+
+
+
+//
+//	Implementation
+//
+
+VertexCacheStats analyze_vertex_cache( const std::vector<uint32_t> &indices, size_t num_vertices, int cache_size ){
+	VertexCacheStats stats;
+	if( indices.empty() ){ return stats; }
+
+	// Timestamp of when each vertex went into the cache, it's still
+	// in there if fewer than cache_size misses happened since
+	std::vector<size_t> added( num_vertices, 0 );
+	std::vector<char> seen( num_vertices, 0 );
+	size_t misses = 0, unique = 0;
+	for( uint32_t v : indices ){
+		if( !seen[v] ){ seen[v] = 1; ++unique; }
+		else if( misses - added[v] < (size_t)cache_size ){ continue; }
+		added[v] = ++misses;
+	}
+
+	stats.acmr = float(misses) / float(indices.size() / 3);
+	stats.atvr = float(misses) / float(unique);
+	return stats;
+}
+
+namespace forsyth {
+
+	static const int CACHE_SIZE = 32;
+	static const int MAX_VALENCE = 64; // scores stop changing much past this
+
+	// Score tables from the paper, recently used and low valence vertices win
+	struct ScoreTable {
+		float cache[CACHE_SIZE];
+		float valence[MAX_VALENCE];
+		ScoreTable(){
+			for( int i = 0; i < CACHE_SIZE; ++i ){
+				if( i < 3 ){ cache[i] = 0.75f; } // the last triangle, doesn't matter which order
+				else { cache[i] = std::pow( 1.f - float(i - 3) / float(CACHE_SIZE - 3), 1.5f ); }
+			}
+			valence[0] = 0.f;
+			for( int i = 1; i < MAX_VALENCE; ++i ){ valence[i] = 2.f * std::pow( float(i), -0.5f ); }
+		}
+		float score( int cache_pos, int live ) const {
+			if( live == 0 ){ return -1.f; }
+			float s = valence[ std::min( live, MAX_VALENCE - 1 ) ];
+			if( cache_pos >= 0 ){ s += cache[cache_pos]; }
+			return s;
+		}
+	};
+
+} // end namespace forsyth
+
+void optimize_vertex_cache( std::vector<uint32_t> &indices, size_t num_vertices ){
+	using namespace forsyth;
+	static const ScoreTable table;
+
+	size_t num_tris = indices.size() / 3;
+	if( num_tris == 0 ){ return; }
+
+	// Triangles touching each vertex, live[v] of them still waiting to be drawn
+	std::vector<uint32_t> live( num_vertices, 0 );
+	for( uint32_t v : indices ){ live[v]++; }
+	std::vector<uint32_t> adj_start( num_vertices + 1, 0 );
+	for( size_t v = 0; v < num_vertices; ++v ){ adj_start[v+1] = adj_start[v] + live[v]; }
+	std::vector<uint32_t> adj( indices.size() );
+	{
+		std::vector<uint32_t> fill( adj_start.begin(), adj_start.end() - 1 );
+		for( size_t i = 0; i < indices.size(); ++i ){ adj[ fill[indices[i]]++ ] = uint32_t(i / 3); }
+	}
+
+	std::vector<int> cache_pos( num_vertices, -1 );
+	std::vector<float> vscore( num_vertices );
+	for( size_t v = 0; v < num_vertices; ++v ){ vscore[v] = table.score( -1, live[v] ); }
+
+	std::vector<float> tscore( num_tris );
+	std::vector<char> emitted( num_tris, 0 );
+	int best = 0;
+	for( size_t t = 0; t < num_tris; ++t ){
+		const uint32_t *tri = &indices[3*t];
+		tscore[t] = vscore[tri[0]] + vscore[tri[1]] + vscore[tri[2]];
+		if( tscore[t] > tscore[best] ){ best = int(t); }
+	}
+
+	std::vector<uint32_t> out;
+	out.reserve( indices.size() );
+	std::vector<uint32_t> cache, next_cache;
+	cache.reserve( CACHE_SIZE + 3 ); next_cache.reserve( CACHE_SIZE + 3 );
+	size_t cursor = 0; // for when the cache runs dry, everything before it is emitted
+
+	while( best >= 0 ){
+		const uint32_t *tri = &indices[3*best];
+		out.insert( out.end(), tri, tri + 3 );
+		emitted[best] = 1;
+
+		// This triangle's vertices move to the front of the cache
+		next_cache.clear();
+		for( int k = 0; k < 3; ++k ){
+			uint32_t v = tri[k];
+			next_cache.push_back( v );
+
+			// Drop the triangle from the vertex's live list
+			uint32_t *list = &adj[ adj_start[v] ];
+			for( uint32_t i = 0; i < live[v]; ++i ){
+				if( list[i] == uint32_t(best) ){ std::swap( list[i], list[live[v]-1] ); break; }
+			}
+			live[v]--;
+		}
+		for( uint32_t v : cache ){
+			if( v != tri[0] && v != tri[1] && v != tri[2] ){ next_cache.push_back( v ); }
+		}
+
+		// Rescore everything that moved, the extra entries just fell out
+		for( size_t i = 0; i < next_cache.size(); ++i ){
+			uint32_t v = next_cache[i];
+			cache_pos[v] = i < (size_t)CACHE_SIZE ? int(i) : -1;
+			vscore[v] = table.score( cache_pos[v], live[v] );
+		}
+
+		// Next triangle is the best one touching the cache
+		best = -1;
+		float best_score = -1.f;
+		for( uint32_t v : next_cache ){
+			const uint32_t *list = &adj[ adj_start[v] ];
+			for( uint32_t i = 0; i < live[v]; ++i ){
+				uint32_t t = list[i];
+				const uint32_t *tt = &indices[3*t];
+				tscore[t] = vscore[tt[0]] + vscore[tt[1]] + vscore[tt[2]];
+				if( tscore[t] > best_score ){ best_score = tscore[t]; best = int(t); }
+			}
+		}
+
+		if( next_cache.size() > (size_t)CACHE_SIZE ){ next_cache.resize( CACHE_SIZE ); }
+		std::swap( cache, next_cache );
+
+		// Nothing in the cache has triangles left, start somewhere new
+		if( best < 0 ){
+			while( cursor < num_tris && emitted[cursor] ){ ++cursor; }
+			if( cursor < num_tris ){ best = int(cursor); }
+		}
+	}
+
+	indices.swap( out );
+}
+
+std::vector<uint32_t> optimize_vertex_fetch( std::vector<uint32_t> &indices, size_t num_vertices ){
+	const uint32_t unused = ~uint32_t(0);
+	std::vector<uint32_t> new_index( num_vertices, unused );
+	std::vector<uint32_t> remap;
+	remap.reserve( num_vertices );
+
+	for( uint32_t &v : indices ){
+		if( new_index[v] == unused ){
+			new_index[v] = uint32_t( remap.size() );
+			remap.push_back( v );
+		}
+		v = new_index[v];
+	}
+	for( size_t v = 0; v < num_vertices; ++v ){
+		if( new_index[v] == unused ){ remap.push_back( uint32_t(v) ); }
+	}
+	return remap;
+}
+
+#endif
@@ -2,26 +2,36 @@
 
 layout(location=0) in vec4 in_position;
 layout(location=1) in vec3 in_color;
-layout(location=2) in vec3 in_normal;
+layout(location=2) in vec2 in_normal; // octahedral encoded, see oct_encode in meshcache.hpp
+layout(location=3) in mat4 in_model; // per instance model matrix, takes locations 3 to 6
 
 out vec3 position;
 out vec3 color;
 out vec3 normal;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// unfold the octahedron back into a unit vector
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+    return normalize(n);
+}
+
 void main()
 {
-    // pass the vertex color and normal information to the fragment shader (without any modification)
+    // pass the vertex color and normal information to the fragment shader
     color = in_color;
-    normal = in_normal;
+    normal = oct_decode(in_normal);
     
     // determine what the vertex position will be after the model transformation and pass that information to the fragment shader, for use in the illumination calculations
     // in our case the model transformation is the identity matrix so this isn't actually necessary, but it's included here for completeness. Note that the vectors needed for the lighting calculations must be computed using the vertex locations *without* perspective warp applied
-    position = vec3(model * in_position);
+    position = vec3(in_model * in_position);
     
     // apply the model, view, and projection transformations to the vertex position value that will be sent to the clipper, rasterizer, ...
-    gl_Position = (projection * view * model * in_position);
+    gl_Position = (projection * view * in_model * in_position);
 }
@@ -0,0 +1,272 @@
+// Quadric error metric simplification (Garland and Heckbert, "Surface Simplification
+// Using Quadric Error Metrics"), used to build the lower detail levels of a mesh.
+
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP 1
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+//
+//	Collapses edges until there are at most target_indices indices left (or
+//	nothing more can go without flipping triangles or opening holes).
+//	Vertices only ever collapse onto other existing vertices, so the result
+//	indexes the same vertex buffer. Vertices at the same position count as
+//	one for the topology, so seams between normals/colors don't tear open.
+//	positions is num_vertices xyz triples, stride floats apart.
+//	error gets roughly how far (in model units) the surface moved.
+//
+std::vector<uint32_t> simplify( const std::vector<uint32_t> &indices, const float *positions, size_t stride,
+	size_t num_vertices, size_t target_indices, float &error );
+
+
+
+//
+//	Implementation
+//
+
+namespace qem {
+
+	// Sum of squared distances to a set of weighted planes
+	struct Quadric {
+		double a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0, ad = 0, bd = 0, cd = 0, d2 = 0, w = 0;
+
+		void add_plane( const double n[3], double d, double weight ){
+			a2 += weight * n[0] * n[0]; b2 += weight * n[1] * n[1]; c2 += weight * n[2] * n[2];
+			ab += weight * n[0] * n[1]; ac += weight * n[0] * n[2]; bc += weight * n[1] * n[2];
+			ad += weight * n[0] * d;    bd += weight * n[1] * d;    cd += weight * n[2] * d;
+			d2 += weight * d * d;       w += weight;
+		}
+		void operator+=( const Quadric &q ){
+			a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac; bc += q.bc;
+			ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2; w += q.w;
+		}
+		double error( const double p[3] ) const {
+			double x = p[0], y = p[1], z = p[2];
+			double e = a2*x*x + b2*y*y + c2*z*z + 2.0*(ab*x*y + ac*x*z + bc*y*z) + 2.0*(ad*x + bd*y + cd*z) + d2;
+			return std::max( e, 0.0 );
+		}
+	};
+
+	static inline void sub( const double *a, const double *b, double *r ){ r[0] = a[0]-b[0]; r[1] = a[1]-b[1]; r[2] = a[2]-b[2]; }
+	static inline void cross( const double *a, const double *b, double *r ){
+		r[0] = a[1]*b[2] - a[2]*b[1]; r[1] = a[2]*b[0] - a[0]*b[2]; r[2] = a[0]*b[1] - a[1]*b[0];
+	}
+	static inline double dot( const double *a, const double *b ){ return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+
+	static inline uint64_t edge_key( uint32_t a, uint32_t b ){
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	}
+
+	struct Collapse {
+		double cost;
+		uint32_t from, to;
+		bool operator<( const Collapse &c ) const { return cost < c.cost; }
+	};
+
+	// How much open edges resist moving, relative to the faces
+	static const double BORDER_WEIGHT = 10.0;
+
+} // end namespace qem
+
+std::vector<uint32_t> simplify( const std::vector<uint32_t> &indices, const float *positions, size_t stride,
+	size_t num_vertices, size_t target_indices, float &error ){
+	using namespace qem;
+	error = 0.f;
+	if( indices.size() <= target_indices || num_vertices == 0 ){ return indices; }
+
+	// Weld vertices at the same position, canon[v] is the first one there
+	std::vector<uint32_t> canon( num_vertices );
+	{
+		std::vector<uint32_t> order( num_vertices );
+		for( size_t v = 0; v < num_vertices; ++v ){ order[v] = uint32_t(v); }
+		auto less = [positions, stride]( uint32_t a, uint32_t b ){
+			return std::memcmp( positions + a*stride, positions + b*stride, 3*sizeof(float) ) < 0;
+		};
+		std::stable_sort( order.begin(), order.end(), less );
+		for( size_t i = 0; i < num_vertices; ++i ){
+			bool same = i > 0 && std::memcmp( positions + order[i]*stride, positions + order[i-1]*stride, 3*sizeof(float) ) == 0;
+			canon[order[i]] = same ? canon[order[i-1]] : order[i];
+		}
+	}
+
+	// Work in a unit box so the quadrics stay well conditioned
+	float lo[3], hi[3];
+	for( int k = 0; k < 3; ++k ){ lo[k] = hi[k] = positions[k]; }
+	for( size_t v = 0; v < num_vertices; ++v ){
+		for( int k = 0; k < 3; ++k ){
+			lo[k] = std::min( lo[k], positions[v*stride + k] );
+			hi[k] = std::max( hi[k], positions[v*stride + k] );
+		}
+	}
+	double extent = std::max( std::max( hi[0] - lo[0], hi[1] - lo[1] ), hi[2] - lo[2] );
+	double scale = extent > 0.0 ? 1.0 / extent : 1.0;
+	std::vector<double> pos( 3 * num_vertices );
+	for( size_t v = 0; v < num_vertices; ++v ){
+		for( int k = 0; k < 3; ++k ){ pos[3*v + k] = (positions[v*stride + k] - lo[k]) * scale; }
+	}
+	const double *P = pos.data();
+
+	// tri is the welded topology, corner the vertex each corner really draws with
+	std::vector<uint32_t> corner( indices ), tri( indices.size() );
+	for( size_t i = 0; i < indices.size(); ++i ){ tri[i] = canon[indices[i]]; }
+
+	std::vector<uint64_t> edges;
+	std::vector<char> border_vert( num_vertices );
+	auto find_borders = [&](){
+		edges.clear();
+		for( size_t i = 0; i < tri.size(); i += 3 ){
+			for( int k = 0; k < 3; ++k ){ edges.push_back( edge_key( tri[i+k], tri[i + (k+1)%3] ) ); }
+		}
+		std::sort( edges.begin(), edges.end() );
+		// keep only the edges there's one of
+		size_t n = 0;
+		for( size_t i = 0; i < edges.size(); ){
+			size_t j = i;
+			while( j < edges.size() && edges[j] == edges[i] ){ ++j; }
+			if( j - i == 1 ){ edges[n++] = edges[i]; }
+			i = j;
+		}
+		edges.resize( n );
+		std::fill( border_vert.begin(), border_vert.end(), 0 );
+		for( uint64_t e : edges ){ border_vert[e >> 32] = 1; border_vert[e & 0xffffffffu] = 1; }
+	};
+	auto is_border = [&edges]( uint32_t a, uint32_t b ){
+		return std::binary_search( edges.begin(), edges.end(), edge_key( a, b ) );
+	};
+
+	// Planes of the faces, plus planes standing up along the open edges
+	std::vector<Quadric> quadrics( num_vertices );
+	find_borders();
+	for( size_t i = 0; i < tri.size(); i += 3 ){
+		const double *p[3] = { P + 3*tri[i], P + 3*tri[i+1], P + 3*tri[i+2] };
+		double e1[3], e2[3], n[3];
+		sub( p[1], p[0], e1 ); sub( p[2], p[0], e2 ); cross( e1, e2, n );
+		double len = std::sqrt( dot( n, n ) );
+		if( len <= 0.0 ){ continue; }
+		for( int k = 0; k < 3; ++k ){ n[k] /= len; }
+		for( int k = 0; k < 3; ++k ){ quadrics[tri[i+k]].add_plane( n, -dot( n, p[0] ), 0.5 * len ); }
+
+		for( int k = 0; k < 3; ++k ){
+			uint32_t a = tri[i+k], b = tri[i + (k+1)%3];
+			if( !is_border( a, b ) ){ continue; }
+			double e[3], m[3];
+			sub( P + 3*b, P + 3*a, e ); cross( e, n, m );
+			double ml = std::sqrt( dot( m, m ) );
+			if( ml <= 0.0 ){ continue; }
+			for( int j = 0; j < 3; ++j ){ m[j] /= ml; }
+			double w = dot( e, e ) * BORDER_WEIGHT;
+			quadrics[a].add_plane( m, -dot( m, P + 3*a ), w );
+			quadrics[b].add_plane( m, -dot( m, P + 3*a ), w );
+		}
+	}
+
+	std::vector<uint32_t> adj_start( num_vertices + 1 ), adj;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap( num_vertices );
+	std::vector<char> locked( num_vertices );
+	double max_error = 0.0;
+	bool first_pass = true;
+
+	// Each pass collapses the cheapest edges that don't touch each other
+	while( tri.size() > target_indices ){
+		if( !first_pass ){ find_borders(); }
+		first_pass = false;
+
+		// Triangles around each vertex
+		std::fill( adj_start.begin(), adj_start.end(), 0 );
+		for( uint32_t v : tri ){ adj_start[v+1]++; }
+		for( size_t v = 0; v < num_vertices; ++v ){ adj_start[v+1] += adj_start[v]; }
+		adj.resize( tri.size() );
+		{
+			std::vector<uint32_t> fill( adj_start.begin(), adj_start.end() - 1 );
+			for( size_t i = 0; i < tri.size(); ++i ){ adj[ fill[tri[i]]++ ] = uint32_t(i / 3); }
+		}
+
+		// Inner edges show up once each way round, so only one side adds them.
+		// Border vertices can only slide along the border.
+		collapses.clear();
+		for( size_t i = 0; i < tri.size(); i += 3 ){
+			for( int k = 0; k < 3; ++k ){
+				uint32_t a = tri[i+k], b = tri[i + (k+1)%3];
+				bool border = ( border_vert[a] || border_vert[b] ) && is_border( a, b );
+				if( a > b && !border ){ continue; }
+				uint32_t ends[2][2] = { { a, b }, { b, a } };
+				for( int d = 0; d < 2; ++d ){
+					uint32_t from = ends[d][0], to = ends[d][1];
+					if( border_vert[from] && !border ){ continue; }
+					Quadric q = quadrics[from]; q += quadrics[to];
+					Collapse c = { q.error( P + 3*to ), from, to };
+					collapses.push_back( c );
+				}
+			}
+		}
+		std::sort( collapses.begin(), collapses.end() );
+
+		// About two triangles go per collapse
+		size_t wanted = (tri.size() - target_indices) / 6 + 1;
+		size_t done = 0;
+		for( size_t v = 0; v < num_vertices; ++v ){ remap[v] = uint32_t(v); }
+		std::fill( locked.begin(), locked.end(), 0 );
+
+		for( const Collapse &c : collapses ){
+			if( done >= wanted ){ break; }
+			if( locked[c.from] || locked[c.to] ){ continue; }
+
+			// Don't let any triangle that's left flip over
+			bool flips = false;
+			const double *pt = P + 3*c.to;
+			for( uint32_t j = adj_start[c.from]; j < adj_start[c.from + 1] && !flips; ++j ){
+				const uint32_t *t = &tri[3 * adj[j]];
+				if( t[0] == c.to || t[1] == c.to || t[2] == c.to ){ continue; }
+				const double *p[3], *q[3];
+				for( int k = 0; k < 3; ++k ){
+					p[k] = P + 3*t[k];
+					q[k] = t[k] == c.from ? pt : p[k];
+				}
+				double e1[3], e2[3], n0[3], n1[3];
+				sub( p[1], p[0], e1 ); sub( p[2], p[0], e2 ); cross( e1, e2, n0 );
+				if( dot( n0, n0 ) <= 0.0 ){ continue; } // already squashed, nothing to flip
+				sub( q[1], q[0], e1 ); sub( q[2], q[0], e2 ); cross( e1, e2, n1 );
+				if( dot( n0, n1 ) <= 0.25 * std::sqrt( dot( n0, n0 ) * dot( n1, n1 ) ) ){ flips = true; }
+			}
+			if( flips ){ continue; }
+
+			// The from vertex's triangles change, so nothing on them moves this pass
+			for( uint32_t j = adj_start[c.from]; j < adj_start[c.from + 1]; ++j ){
+				const uint32_t *t = &tri[3 * adj[j]];
+				locked[t[0]] = locked[t[1]] = locked[t[2]] = 1;
+			}
+			locked[c.to] = 1;
+
+			Quadric q = quadrics[c.from]; q += quadrics[c.to];
+			max_error = std::max( max_error, std::sqrt( c.cost / std::max( q.w, 1e-12 ) ) );
+			quadrics[c.to] = q;
+			remap[c.from] = c.to;
+			++done;
+		}
+		if( done == 0 ){ break; }
+
+		// Move the collapsed corners and drop the triangles that got squashed
+		size_t n = 0;
+		for( size_t i = 0; i < tri.size(); i += 3 ){
+			uint32_t t[3], v[3];
+			for( int k = 0; k < 3; ++k ){
+				t[k] = remap[tri[i+k]];
+				v[k] = t[k] == tri[i+k] ? corner[i+k] : t[k];
+			}
+			if( t[0] == t[1] || t[1] == t[2] || t[0] == t[2] ){ continue; }
+			for( int k = 0; k < 3; ++k ){ tri[n+k] = t[k]; corner[n+k] = v[k]; }
+			n += 3;
+		}
+		tri.resize( n ); corner.resize( n );
+	}
+
+	error = float( max_error / scale );
+	return corner;
+}
+
+#endif
@@ -0,0 +1,572 @@
+// Checks for the parts that don't need a window or OpenGL (ctest runs them),
+// ./hw2b_tests <cull|normals|vecmath|all> [file.obj]
+// Exits non-zero if anything failed.
+
+#include "trimesh.hpp"
+#include "vecmath.hpp"
+#include "cull.hpp"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <random>
+#include <array>
+#include <algorithm>
+
+static int failures = 0;
+
+#define CHECK( cond ) do { if( !(cond) ){ \
+	std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " << #cond << std::endl; \
+	++failures; } } while( 0 )
+
+// Projection * view looking from eye at target, the same way main.cpp builds it.
+// The near and far planes go with how big the scene is.
+static Mat4x4 make_clip( const Vec3f &eye, const Vec3f &target, float fovy = 1.f, float scene_size = 1.f ){
+	Mat4x4 proj, view;
+	proj.make_perspective( fovy, 1.f, 0.01f * scene_size, 100.f * scene_size );
+	view.make_look_at( eye, target, Vec3f(0, 1, 0) );
+	return proj * view;
+}
+
+static int classify_point( const Frustum &f, const Vec3f &p ){
+	float b[3] = { p[0], p[1], p[2] };
+	return f.classify( b, b );
+}
+
+//
+//	Frustum planes and classify
+//
+
+static void test_identity_frustum(){
+	// The identity clip matrix is the -1..1 cube
+	Mat4x4 id;
+	Frustum f( id.m );
+
+	float in_min[3] = { -0.5f, -0.5f, -0.5f }, in_max[3] = { 0.5f, 0.5f, 0.5f };
+	float edge_min[3] = { 0.5f, -0.5f, -0.5f }, edge_max[3] = { 1.5f, 0.5f, 0.5f };
+	float out_min[3] = { 2.f, -0.5f, -0.5f }, out_max[3] = { 3.f, 0.5f, 0.5f };
+	float big_min[3] = { -5.f, -5.f, -5.f }, big_max[3] = { 5.f, 5.f, 5.f };
+	// Overlaps along x but is off to the side in z
+	float side_min[3] = { -5.f, -0.5f, 2.f }, side_max[3] = { 5.f, 0.5f, 3.f };
+
+	CHECK( f.classify( in_min, in_max ) == Frustum::INSIDE );
+	CHECK( f.classify( edge_min, edge_max ) == Frustum::INTERSECTS );
+	CHECK( f.classify( out_min, out_max ) == Frustum::OUTSIDE );
+	CHECK( f.classify( big_min, big_max ) == Frustum::INTERSECTS );
+	CHECK( f.classify( side_min, side_max ) == Frustum::OUTSIDE );
+}
+
+static void test_perspective_frustum(){
+	Mat4x4 clip = make_clip( Vec3f(0, 0, 5), Vec3f(0, 0, 0) );
+	Frustum f( clip.m );
+
+	CHECK( classify_point( f, Vec3f(0, 0, 0) ) == Frustum::INSIDE );
+	CHECK( classify_point( f, Vec3f(0, 0, 6) ) == Frustum::OUTSIDE ); // behind the camera
+	CHECK( classify_point( f, Vec3f(0, 0, 4.995f) ) == Frustum::OUTSIDE ); // before the near plane
+	CHECK( classify_point( f, Vec3f(0, 0, -96.f) ) == Frustum::OUTSIDE ); // past the far plane
+	CHECK( classify_point( f, Vec3f(10, 0, 0) ) == Frustum::OUTSIDE );
+
+	// Every plane against the clip space test (-w <= x,y,z <= w) for a pile of points,
+	// skipping the ones too close to a plane for the float rounding to agree
+	std::mt19937 rng( 1 );
+	std::uniform_real_distribution<float> coord( -20.f, 20.f );
+	int compared = 0;
+	for( int n = 0; n < 20000; ++n ){
+		Vec3f p( coord(rng), coord(rng), coord(rng) );
+		float c[4];
+		for( int r = 0; r < 4; ++r ){ c[r] = clip.m[4*r]*p[0] + clip.m[4*r + 1]*p[1] + clip.m[4*r + 2]*p[2] + clip.m[4*r + 3]; }
+
+		bool inside = true, close = false;
+		for( int k = 0; k < 3; ++k ){
+			float lo = c[3] + c[k], hi = c[3] - c[k];
+			float tol = 1e-4f * ( std::fabs(c[3]) + std::fabs(c[k]) );
+			if( std::fabs(lo) < tol || std::fabs(hi) < tol ){ close = true; }
+			if( lo < 0.f || hi < 0.f ){ inside = false; }
+		}
+		if( close ){ continue; }
+
+		CHECK( ( classify_point( f, p ) == Frustum::INSIDE ) == inside );
+		++compared;
+	}
+	CHECK( compared > 10000 );
+}
+
+//
+//	build_chunks
+//
+
+// Checks node i and everything under it, returns its skip
+static uint32_t check_subtree( const std::vector<MeshChunk> &chunks, uint32_t i, const std::vector<uint32_t> &indices,
+	const std::vector<float> &positions, uint32_t leaf_tris, size_t &leaf_indices ){
+
+	const MeshChunk &c = chunks[i];
+	CHECK( c.skip > i && c.skip <= chunks.size() );
+	CHECK( c.num_indices % 3 == 0 && c.num_indices > 0 );
+
+	// Every triangle of the subtree is inside its box
+	for( uint32_t k = c.first_index; k < c.first_index + c.num_indices; ++k ){
+		const float *p = &positions[3 * indices[k]];
+		for( int a = 0; a < 3; ++a ){ CHECK( p[a] >= c.bmin[a] && p[a] <= c.bmax[a] ); }
+	}
+
+	if( c.skip == i + 1 ){
+		CHECK( c.num_indices / 3 <= leaf_tris );
+		leaf_indices += c.num_indices;
+		return c.skip;
+	}
+
+	// Two children right after it, one run of indices split in two
+	CHECK( c.num_indices / 3 > leaf_tris );
+	uint32_t second = check_subtree( chunks, i + 1, indices, positions, leaf_tris, leaf_indices );
+	CHECK( second < c.skip );
+	if( second >= c.skip ){ return c.skip; }
+	uint32_t end = check_subtree( chunks, second, indices, positions, leaf_tris, leaf_indices );
+	CHECK( end == c.skip );
+
+	const MeshChunk &a = chunks[i + 1], &b = chunks[second];
+	CHECK( a.first_index == c.first_index );
+	CHECK( b.first_index == a.first_index + a.num_indices );
+	CHECK( a.num_indices + b.num_indices == c.num_indices );
+	return c.skip;
+}
+
+// Triangles as sorted index triples, to compare before and after ignoring order
+static std::vector<std::array<uint32_t,3>> sorted_tris( const std::vector<uint32_t> &indices ){
+	std::vector<std::array<uint32_t,3>> tris( indices.size() / 3 );
+	for( size_t t = 0; t < tris.size(); ++t ){ tris[t] = {{ indices[3*t], indices[3*t + 1], indices[3*t + 2] }}; }
+	std::sort( tris.begin(), tris.end() );
+	return tris;
+}
+
+static void test_build_chunks( const std::vector<uint32_t> &mesh_indices, const std::vector<float> &positions ){
+	const uint32_t leaf_sizes[] = { 1, 7, 64, 2048, 1u << 30 };
+	for( uint32_t leaf_tris : leaf_sizes ){
+		std::vector<uint32_t> indices = mesh_indices;
+		std::vector<MeshChunk> chunks = build_chunks( indices, positions.data(), 3, leaf_tris );
+
+		CHECK( indices.size() == mesh_indices.size() );
+		CHECK( sorted_tris( indices ) == sorted_tris( mesh_indices ) );
+
+		CHECK( !chunks.empty() );
+		if( chunks.empty() ){ continue; }
+		CHECK( chunks[0].first_index == 0 && chunks[0].num_indices == indices.size() );
+		CHECK( chunks[0].skip == chunks.size() );
+
+		size_t leaf_indices = 0;
+		check_subtree( chunks, 0, indices, positions, leaf_tris, leaf_indices );
+		CHECK( leaf_indices == indices.size() );
+	}
+
+	// Nothing in, nothing out
+	std::vector<uint32_t> none;
+	CHECK( build_chunks( none, positions.data(), 3 ).empty() );
+}
+
+//
+//	cull_chunks
+//
+
+// Ranges are in order, don't overlap and nothing that touches was left unmerged
+static void check_ranges( const std::vector<DrawRange> &ranges, size_t num_indices ){
+	for( size_t r = 0; r < ranges.size(); ++r ){
+		CHECK( ranges[r].num_indices > 0 && ranges[r].num_indices % 3 == 0 );
+		CHECK( ranges[r].first_index + ranges[r].num_indices <= num_indices );
+		if( r > 0 ){ CHECK( ranges[r-1].first_index + ranges[r-1].num_indices < ranges[r].first_index ); }
+	}
+}
+
+static void test_cull_chunks( const std::vector<uint32_t> &mesh_indices, const std::vector<float> &positions ){
+	std::vector<uint32_t> indices = mesh_indices;
+	std::vector<MeshChunk> chunks = build_chunks( indices, positions.data(), 3, 64 );
+	size_t num_tris = indices.size() / 3;
+
+	// Which leaf every triangle ended up in
+	std::vector<uint32_t> leaf_of( num_tris );
+	for( uint32_t i = 0; i < chunks.size(); ++i ){
+		if( chunks[i].skip != i + 1 ){ continue; }
+		for( uint32_t t = chunks[i].first_index / 3; t < (chunks[i].first_index + chunks[i].num_indices) / 3; ++t ){ leaf_of[t] = i; }
+	}
+
+	const float *bmin = chunks[0].bmin, *bmax = chunks[0].bmax;
+	Vec3f center( 0.5f * (bmin[0] + bmax[0]), 0.5f * (bmin[1] + bmax[1]), 0.5f * (bmin[2] + bmax[2]) );
+	Vec3f extent( bmax[0] - bmin[0], bmax[1] - bmin[1], bmax[2] - bmin[2] );
+	float size = std::max( extent[0], std::max( extent[1], extent[2] ) );
+
+	// Orbit around the mesh at a few distances, some views take in all of it,
+	// some only a corner, some look away from it
+	size_t views = 0, partial = 0;
+	for( int ring = 0; ring < 3; ++ring ){
+		float dist = size * ( 0.3f + ring );
+		for( int step = 0; step < 12; ++step ){
+			float angle = step * 0.5236f;
+			Vec3f eye = center + Vec3f( std::cos(angle), 0.3f, std::sin(angle) ) * dist;
+			Vec3f targets[3] = { center, center + Vec3f(extent[0] * 0.4f, 0, 0), eye * 2.f - center };
+			for( const Vec3f &target : targets ){
+				Mat4x4 clip = make_clip( eye, target, 0.6f, size );
+				Frustum f( clip.m );
+
+				std::vector<DrawRange> ranges;
+				size_t added = cull_chunks( f, chunks.data(), chunks.size(), ranges );
+				CHECK( added == ranges.size() );
+				check_ranges( ranges, indices.size() );
+
+				std::vector<char> drawn( num_tris, 0 );
+				for( const DrawRange &r : ranges ){
+					for( uint32_t t = r.first_index / 3; t < (r.first_index + r.num_indices) / 3; ++t ){ drawn[t] = 1; }
+				}
+
+				// Brute force: every triangle that might be visible is drawn, and
+				// anything drawn came from a leaf that wasn't outside
+				size_t num_drawn = 0;
+				for( size_t t = 0; t < num_tris; ++t ){
+					float tmin[3] = { INFINITY, INFINITY, INFINITY }, tmax[3] = { -INFINITY, -INFINITY, -INFINITY };
+					for( int j = 0; j < 3; ++j ){
+						const float *p = &positions[3 * indices[3*t + j]];
+						for( int k = 0; k < 3; ++k ){ tmin[k] = std::min( tmin[k], p[k] ); tmax[k] = std::max( tmax[k], p[k] ); }
+					}
+					if( f.classify( tmin, tmax ) != Frustum::OUTSIDE ){ CHECK( drawn[t] ); }
+					if( drawn[t] ){
+						const MeshChunk &leaf = chunks[leaf_of[t]];
+						CHECK( f.classify( leaf.bmin, leaf.bmax ) != Frustum::OUTSIDE );
+						++num_drawn;
+					}
+				}
+				if( num_drawn > 0 && num_drawn < num_tris ){ ++partial; }
+				++views;
+			}
+		}
+	}
+	CHECK( views == 108 );
+	CHECK( partial > 0 ); // the orbit has to actually test something
+
+	// Far enough back to see all of it is one range, looking away is nothing
+	Vec3f back = center + Vec3f(0, 0, 1) * (size * 4.f);
+	Frustum all( make_clip( back, center, 1.f, size ).m );
+	std::vector<DrawRange> ranges;
+	CHECK( cull_chunks( all, chunks.data(), chunks.size(), ranges ) == 1 );
+	CHECK( ranges.size() == 1 && ranges[0].first_index == 0 && ranges[0].num_indices == indices.size() );
+
+	Frustum away( make_clip( back, back * 2.f - center, 1.f, size ).m );
+	ranges.clear();
+	CHECK( cull_chunks( away, chunks.data(), chunks.size(), ranges ) == 0 );
+	CHECK( ranges.empty() );
+}
+
+static void test_range_merging(){
+	// A root over four leaves, against the -1..1 cube:
+	// leaves 0 and 1 are in (and next to each other), 2 is out, 3 is partly in
+	Mat4x4 id;
+	Frustum f( id.m );
+	MeshChunk chunks[7] = {
+		{ { -5, -1, -1 }, { 5, 1, 1 }, 0, 12, 7 },
+		{ { -5, -1, -1 }, { 0, 1, 1 }, 0, 6, 4 },
+		{ { -0.5f, -0.5f, -0.5f }, { 0, 0.5f, 0.5f }, 0, 3, 3 },
+		{ { -0.9f, -0.5f, -0.5f }, { -0.6f, 0.5f, 0.5f }, 3, 3, 4 },
+		{ { 0, -1, -1 }, { 5, 1, 1 }, 6, 6, 7 },
+		{ { 3, -1, -1 }, { 5, 1, 1 }, 6, 3, 6 },
+		{ { 0.5f, -0.5f, -0.5f }, { 2, 0.5f, 0.5f }, 9, 3, 7 },
+	};
+
+	std::vector<DrawRange> ranges;
+	CHECK( cull_chunks( f, chunks, 7, ranges ) == 2 );
+	CHECK( ranges.size() == 2 );
+	if( ranges.size() == 2 ){
+		CHECK( ranges[0].first_index == 0 && ranges[0].num_indices == 6 ); // leaves 0 and 1 as one
+		CHECK( ranges[1].first_index == 9 && ranges[1].num_indices == 3 );
+	}
+
+	// Appending doesn't merge into what was already in the list,
+	// even when it happens to end right where the first new range starts
+	ranges.clear();
+	DrawRange earlier = { 0, 0 };
+	ranges.push_back( earlier );
+	CHECK( cull_chunks( f, chunks, 7, ranges ) == 2 );
+	CHECK( ranges.size() == 3 && ranges[0].num_indices == 0 );
+
+	// Every leaf in: the whole buffer in one go
+	Mat4x4 wide;
+	wide.make_scale( 0.1f, 0.1f, 0.1f );
+	Frustum all( wide.m );
+	ranges.clear();
+	CHECK( cull_chunks( all, chunks, 7, ranges ) == 1 );
+	CHECK( ranges.size() == 1 && ranges[0].first_index == 0 && ranges[0].num_indices == 12 );
+}
+
+//
+//	TriMesh::need_normals split over threads
+//
+
+// The plain loop need_normals had before it was split over threads
+static std::vector<Vec3f> serial_normals( const TriMesh &mesh ){
+	std::vector<Vec3f> normals( mesh.vertices.size() );
+	for( const Vec3i &face : mesh.faces ){
+		const Vec3f &p0 = mesh.vertices[ face[0] ];
+		const Vec3f &p1 = mesh.vertices[ face[1] ];
+		const Vec3f &p2 = mesh.vertices[ face[2] ];
+
+		Vec3f a = p0-p1,  b = p1-p2, c = p2-p0;
+		float l2a = a.len2(), l2b = b.len2(), l2c = c.len2();
+		if (!l2a || !l2b || !l2c){ continue; }
+		Vec3f facenormal = a.cross( b );
+		normals[face[0]] += facenormal * (1.0f / (l2a * l2c));
+		normals[face[1]] += facenormal * (1.0f / (l2b * l2a));
+		normals[face[2]] += facenormal * (1.0f / (l2c * l2b));
+	}
+	for( Vec3f &n : normals ){ n.normalize(); }
+	return normals;
+}
+
+// Wavy grid, big enough that every thread gets plenty of faces
+static TriMesh make_grid( int n ){
+	TriMesh mesh;
+	for( int i = 0; i < n; ++i ){
+		for( int j = 0; j < n; ++j ){
+			float x = float(i) / n, z = float(j) / n;
+			mesh.vertices.push_back( Vec3f( x, 0.1f * std::sin( 20.f * x ) * std::cos( 13.f * z ), z ) );
+		}
+	}
+	for( int i = 0; i + 1 < n; ++i ){
+		for( int j = 0; j + 1 < n; ++j ){
+			int v = i*n + j;
+			mesh.faces.push_back( Vec3i( v, v+1, v+n ) );
+			mesh.faces.push_back( Vec3i( v+1, v+n+1, v+n ) );
+		}
+	}
+	mesh.faces.push_back( Vec3i( 0, 0, 1 ) ); // degenerate, skipped
+	mesh.vertices.push_back( Vec3f( 2, 2, 2 ) ); // not used by any face, stays zero
+	return mesh;
+}
+
+static void test_normals( TriMesh mesh ){
+	std::vector<Vec3f> expected = serial_normals( mesh );
+	for( size_t threads : { 1, 2, 3, 4, 8 } ){
+		mesh.need_normals( true, threads );
+		CHECK( mesh.normals.size() == expected.size() );
+		if( mesh.normals.size() != expected.size() ){ continue; }
+
+		// Only the order of the sums changes, and with one thread not even that
+		float tolerance = threads == 1 ? 0.f : 1e-5f;
+		size_t bad = 0;
+		for( size_t i = 0; i < expected.size(); ++i ){
+			for( int k = 0; k < 3; ++k ){
+				if( !( std::abs( mesh.normals[i][k] - expected[i][k] ) <= tolerance ) ){ ++bad; break; }
+			}
+		}
+		if( bad > 0 ){ std::cerr << bad << " normals off with " << threads << " threads" << std::endl; }
+		CHECK( bad == 0 );
+	}
+}
+
+//
+//	Mat4x4 multiply, inverse and look_at
+//
+
+// The plain triple loop, what the four at a time version has to match
+static Mat4x4 reference_mul( const Mat4x4 &a, const Mat4x4 &b ){
+	Mat4x4 r;
+	for( int i = 0; i < 4; ++i ){
+		for( int j = 0; j < 4; ++j ){
+			double sum = 0.0;
+			for( int k = 0; k < 4; ++k ){ sum += double( a.m[4*i + k] ) * b.m[4*k + j]; }
+			r.m[4*i + j] = float( sum );
+		}
+	}
+	return r;
+}
+
+static float max_diff( const Mat4x4 &a, const Mat4x4 &b ){
+	float d = 0.f;
+	for( int i = 0; i < 16; ++i ){ d = std::max( d, std::abs( a.m[i] - b.m[i] ) ); }
+	return d;
+}
+
+static Mat4x4 random_matrix( std::mt19937 &rng ){
+	std::uniform_real_distribution<float> u( -1.f, 1.f );
+	Mat4x4 r;
+	for( int i = 0; i < 16; ++i ){ r.m[i] = u( rng ); }
+	return r;
+}
+
+// Rotation then translation, like the instance matrices
+static Mat4x4 random_rigid( std::mt19937 &rng ){
+	std::uniform_real_distribution<float> u( -1.f, 1.f );
+	Mat4x4 rot, move;
+	rot.make_rotation( Quat::axis_angle( Vec3f( u( rng ), u( rng ), u( rng ) ), 3.f * u( rng ) ) );
+	move.make_translation( 20.f * u( rng ), 20.f * u( rng ), 20.f * u( rng ) );
+	return move * rot;
+}
+
+static void test_multiply(){
+	std::mt19937 rng( 5 );
+	for( int i = 0; i < 100; ++i ){
+		Mat4x4 a = random_matrix( rng ), b = random_matrix( rng );
+		CHECK( max_diff( a * b, reference_mul( a, b ) ) < 1e-5f );
+	}
+
+	Mat4x4 id, a = random_matrix( rng );
+	CHECK( max_diff( id * a, a ) == 0.f && max_diff( a * id, a ) == 0.f );
+
+	// Translate after scaling moves the scaled point
+	Mat4x4 scale, move;
+	scale.make_scale( 2.f, 3.f, 4.f );
+	move.make_translation( 1.f, 2.f, 3.f );
+	Vec3f p = ( move * scale ) * Vec3f( 1, 1, 1 );
+	CHECK( p[0] == 3.f && p[1] == 5.f && p[2] == 7.f );
+}
+
+// m * inverse and inverse * m both have to come out the identity
+static void check_inverse( const Mat4x4 &m, float tolerance ){
+	Mat4x4 inv, id;
+	bool ok = m.inverse( inv );
+	CHECK( ok );
+	if( !ok ){ return; }
+	CHECK( max_diff( reference_mul( m, inv ), id ) < tolerance );
+	CHECK( max_diff( reference_mul( inv, m ), id ) < tolerance );
+}
+
+static void test_inverse(){
+	std::mt19937 rng( 11 );
+	for( int i = 0; i < 100; ++i ){
+		// Pushed away from singular so float rounding doesn't decide the result
+		Mat4x4 m = random_matrix( rng );
+		for( int k = 0; k < 4; ++k ){ m.m[5*k] += 3.f; }
+		check_inverse( m, 1e-5f );
+	}
+
+	for( int i = 0; i < 100; ++i ){
+		Mat4x4 m = random_rigid( rng );
+		check_inverse( m, 1e-5f );
+
+		// Undoes the instance matrix, which is what picking the level of detail relies on
+		Mat4x4 inv;
+		m.inverse( inv );
+		Vec3f p( 3.f, -2.f, 7.f );
+		CHECK( ( inv * ( m * p ) - p ).len2() < 1e-8 );
+	}
+
+	Mat4x4 proj, view;
+	proj.make_perspective( 1.f, 1.5f, 0.1f, 100.f );
+	view.make_look_at( Vec3f( 4, 3, 5 ), Vec3f( 0, 0, 0 ), Vec3f( 0, 1, 0 ) );
+	check_inverse( proj, 1e-5f );
+	check_inverse( view, 1e-5f );
+	check_inverse( proj * view, 1e-4f );
+
+	// Rank 2, the determinant comes out exactly zero
+	Mat4x4 singular, out;
+	float rows[16] = { 1, 2, 3, 4,  2, 4, 6, 8,  0, 1, 0, 1,  1, 3, 3, 5 };
+	for( int i = 0; i < 16; ++i ){ singular.m[i] = rows[i]; }
+	out.make_scale( 7.f, 7.f, 7.f );
+	Mat4x4 before = out;
+	CHECK( !singular.inverse( out ) );
+	CHECK( max_diff( out, before ) == 0.f ); // left alone
+	Mat4x4 flat;
+	flat.make_scale( 1.f, 0.f, 1.f );
+	CHECK( !flat.inverse( out ) );
+}
+
+static void test_look_at(){
+	std::mt19937 rng( 3 );
+	std::uniform_real_distribution<float> u( -10.f, 10.f );
+	for( int i = 0; i < 100; ++i ){
+		Vec3f eye( u( rng ), u( rng ), u( rng ) ), target( u( rng ), u( rng ), u( rng ) );
+		Mat4x4 view;
+		view.make_look_at( eye, target, Vec3f( 0, 1, 0 ) );
+
+		// The eye ends up at the origin and the target straight down -z
+		Vec3f e = view * eye, t = view * target;
+		float dist = std::sqrt( float( ( target - eye ).len2() ) );
+		CHECK( e.len2() < 1e-8 );
+		CHECK( std::abs( t[0] ) < 1e-4f && std::abs( t[1] ) < 1e-4f && std::abs( t[2] + dist ) < 1e-4f );
+
+		// The rotation part is orthonormal and right handed
+		Vec3f r0( view.m[0], view.m[1], view.m[2] ), r1( view.m[4], view.m[5], view.m[6] ), r2( view.m[8], view.m[9], view.m[10] );
+		CHECK( std::abs( r0.len2() - 1.0 ) < 1e-5 && std::abs( r1.len2() - 1.0 ) < 1e-5 && std::abs( r2.len2() - 1.0 ) < 1e-5 );
+		CHECK( std::abs( r0.dot( r1 ) ) < 1e-5f && std::abs( r0.dot( r2 ) ) < 1e-5f && std::abs( r1.dot( r2 ) ) < 1e-5f );
+		CHECK( ( r0.cross( r1 ) - r2 ).len2() < 1e-8 );
+
+		// Up stays up: the camera's x axis is level
+		CHECK( std::abs( r0[1] ) < 1e-5f );
+		CHECK( view.m[12] == 0.f && view.m[13] == 0.f && view.m[14] == 0.f && view.m[15] == 1.f );
+	}
+}
+
+static bool load( TriMesh &mesh, const std::string &obj ){
+	if( mesh.load_obj( obj ) ){ return true; }
+	std::cerr << "Could not load " << obj << std::endl;
+	++failures;
+	return false;
+}
+
+//
+//	Normals from the obj file
+//
+
+// Only the first corner has a "vn", the other vertices get computed ones
+// and the one from the file is kept even though it doesn't match the face
+static void test_obj_normals(){
+	const char *path = "mixed_normals.obj";
+	{
+		std::ofstream out( path );
+		out << "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nvn 1 0 0\n";
+		out << "f 1//1 2 3\nf 2 4 3\n";
+	}
+	TriMesh mesh;
+	bool loaded = load( mesh, path );
+	std::remove( path );
+	if( !loaded ){ return; }
+
+	CHECK( mesh.vertices.size() == 4 && mesh.normals.size() == 4 );
+	for( size_t i = 0; i < mesh.vertices.size() && i < mesh.normals.size(); ++i ){
+		Vec3f expected = mesh.vertices[i].len2() == 0 ? Vec3f( 1, 0, 0 ) : Vec3f( 0, 0, 1 );
+		CHECK( ( mesh.normals[i] - expected ).len2() < 1e-10 );
+	}
+}
+
+static void test_cull( const std::string &obj ){
+	TriMesh mesh;
+	if( !load( mesh, obj ) ){ return; }
+
+	std::vector<float> positions( 3 * mesh.vertices.size() );
+	for( size_t v = 0; v < mesh.vertices.size(); ++v ){
+		for( int k = 0; k < 3; ++k ){ positions[3*v + k] = mesh.vertices[v][k]; }
+	}
+	std::vector<uint32_t> indices( 3 * mesh.faces.size() );
+	for( size_t f = 0; f < mesh.faces.size(); ++f ){
+		for( int k = 0; k < 3; ++k ){ indices[3*f + k] = uint32_t( mesh.faces[f][k] ); }
+	}
+
+	test_identity_frustum();
+	test_perspective_frustum();
+	test_build_chunks( indices, positions );
+	test_cull_chunks( indices, positions );
+	test_range_merging();
+}
+
+int main( int argc, char *argv[] ){
+	std::string group = argc > 1 ? argv[1] : "all";
+	std::string obj = argc > 2 ? argv[2] : MY_DATA_DIR "biwer/kiwi1.obj";
+	bool all = group == "all";
+	if( !all && group != "cull" && group != "normals" && group != "vecmath" ){
+		std::cerr << "Usage: " << argv[0] << " <cull|normals|vecmath|all> [file.obj]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if( all || group == "cull" ){ test_cull( obj ); }
+	if( all || group == "normals" ){
+		TriMesh mesh;
+		if( load( mesh, obj ) ){ test_normals( mesh ); }
+		test_normals( make_grid( 300 ) );
+		test_obj_normals();
+	}
+	if( all || group == "vecmath" ){
+		test_multiply();
+		test_inverse();
+		test_look_at();
+	}
+
+	if( failures > 0 ){
+		std::cerr << failures << " check(s) failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "All " << group << " checks passed" << std::endl;
+	return EXIT_SUCCESS;
+}
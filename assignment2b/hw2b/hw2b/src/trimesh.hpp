@@ -27,6 +27,18 @@
 #include <cmath>
 #include <iostream>
 #include <assert.h>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 //
 //	Vector Class
@@ -112,7 +124,8 @@ public:
 
 	// Compute normals if not loaded from obj
 	// or if recompute is set to true.
-	void need_normals( bool recompute=false );
+	// threads=0 picks how many by the mesh size.
+	void need_normals( bool recompute=false, size_t threads=0 );
 
 	// Sets a default vertex color if
 	// they haven't been set.
@@ -139,28 +152,61 @@ void TriMesh::print_details(){
 }
 
 
-void TriMesh::need_normals( bool recompute ){
+// How many threads are worth it for n items, at least min_per_thread each
+static inline size_t parallel_threads( size_t n, size_t min_per_thread = 16384 ){
+	size_t threads = std::max( 1u, std::thread::hardware_concurrency() );
+	return std::min( threads, std::max( size_t(1), n / min_per_thread ) );
+}
+
+// Splits [0,n) into one contiguous range per thread and runs fn(thread,begin,end)
+// on each, the first range runs on the calling thread
+template <typename F> static inline void parallel_ranges( size_t n, size_t threads, F fn ){
+	std::vector<std::thread> pool;
+	for( size_t t = 1; t < threads; ++t ){
+		size_t begin = n * t / threads, end = n * (t+1) / threads;
+		pool.push_back( std::thread( [&fn, t, begin, end](){ fn( t, begin, end ); } ) );
+	}
+	fn( size_t(0), size_t(0), n / std::max( threads, size_t(1) ) );
+	for( std::thread &t : pool ){ t.join(); }
+}
+
+void TriMesh::need_normals( bool recompute, size_t threads ){
 	if( vertices.size() == normals.size() && !recompute ){ return; }
 	if( normals.size() != vertices.size() ){ normals.resize( vertices.size() ); }
 	std::cout << "Computing TriMesh normals" << std::endl;
-	const int nv = normals.size();
-	for( int i = 0; i < nv; ++i ){ normals[i][0] = 0.f; normals[i][1] = 0.f; normals[i][2] = 0.f; }
-	int nf = faces.size();
-	for( int f = 0; f < nf; ++f ){
-		Vec3i face = faces[f];
-		const Vec3f &p0 = vertices[ face[0] ];
-		const Vec3f &p1 = vertices[ face[1] ];
-		const Vec3f &p2 = vertices[ face[2] ];
-		
-		Vec3f a = p0-p1,  b = p1-p2, c = p2-p0;
-		float l2a = a.len2(), l2b = b.len2(), l2c = c.len2();
-		if (!l2a || !l2b || !l2c){ continue; } // check for zeros or nans
-		Vec3f facenormal = a.cross( b );
-		normals[faces[f][0]] += facenormal * (1.0f / (l2a * l2c));
-		normals[faces[f][1]] += facenormal * (1.0f / (l2b * l2a));
-		normals[faces[f][2]] += facenormal * (1.0f / (l2c * l2b));
-	}
-	for (int i = 0; i < nv; i++){ normals[i].normalize(); }
+	const size_t nv = normals.size(), nf = faces.size();
+	for( size_t i = 0; i < nv; ++i ){ normals[i][0] = 0.f; normals[i][1] = 0.f; normals[i][2] = 0.f; }
+
+	// Each thread sums its share of the faces into its own buffer (the first
+	// one straight into normals), then the buffers get added up per vertex.
+	// With one thread this is exactly the old serial loop.
+	if( threads == 0 ){ threads = parallel_threads( nf ); }
+	std::vector< std::vector<Vec3f> > partial( threads - 1 );
+	parallel_ranges( nf, threads, [&]( size_t t, size_t begin, size_t end ){
+		std::vector<Vec3f> &acc = t == 0 ? normals : partial[t-1];
+		if( t > 0 ){ acc.resize( nv ); }
+		for( size_t f = begin; f < end; ++f ){
+			Vec3i face = faces[f];
+			const Vec3f &p0 = vertices[ face[0] ];
+			const Vec3f &p1 = vertices[ face[1] ];
+			const Vec3f &p2 = vertices[ face[2] ];
+
+			Vec3f a = p0-p1,  b = p1-p2, c = p2-p0;
+			float l2a = a.len2(), l2b = b.len2(), l2c = c.len2();
+			if (!l2a || !l2b || !l2c){ continue; } // check for zeros or nans
+			Vec3f facenormal = a.cross( b );
+			acc[face[0]] += facenormal * (1.0f / (l2a * l2c));
+			acc[face[1]] += facenormal * (1.0f / (l2b * l2a));
+			acc[face[2]] += facenormal * (1.0f / (l2c * l2b));
+		}
+	} );
+
+	parallel_ranges( nv, threads, [&]( size_t, size_t begin, size_t end ){
+		for( size_t i = begin; i < end; ++i ){
+			for( const std::vector<Vec3f> &p : partial ){ normals[i] += p[i]; }
+			normals[i].normalize();
+		}
+	} );
 } // end need normals
 
 void TriMesh::need_colors( Vec3f default_color ){
@@ -168,148 +214,278 @@ void TriMesh::need_colors( Vec3f default_color ){
 	else{ colors.resize( vertices.size(), default_color ); }
 } // end need colors
 
-// Function to split a string into multiple strings, seperated by delimeter
-static void split_str( char delim, const std::string &str, std::vector<std::string> *result ){
-	std::stringstream ss(str); std::string s;
-	while( std::getline(ss, s, delim) ){ result->push_back(s); }
-}
-
-bool TriMesh::load_obj( std::string file ){
+//
+//	OBJ parsing helpers
+//
 
-	std::cout << "\nLoading " << file << std::endl;
+// Read only view of a whole file.
+// mmapped where that's available, otherwise read into memory.
+class MappedFile {
+public:
+	const char *data = nullptr;
+	size_t size = 0;
+
+	MappedFile(){}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile(){ close(); }
+
+	void close(){
+#ifndef _WIN32
+		if( map ){ munmap( map, size ); map = nullptr; }
+#else
+		buffer.clear();
+#endif
+		data = nullptr; size = 0;
+	}
 
-	//	README:
-	//
-	//	The problem with standard obj files and opengl is that
-	//	there isn't a good way to make triangles with different indices
-	//	for vertices/normals. At least, not any way that I'm aware of.
-	//	So for now, we'll do the inefficient (but robust) way:
-	//	redundant vertices/normals.
-	//
+	bool open( const std::string &file ){
+#ifndef _WIN32
+		close();
+		int fd = ::open( file.c_str(), O_RDONLY );
+		if( fd < 0 ){ return false; }
+		struct stat st;
+		if( fstat( fd, &st ) != 0 ){ ::close( fd ); return false; }
+		size = st.st_size;
+		if( size > 0 ){
+			map = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( map == MAP_FAILED ){ map = nullptr; size = 0; ::close( fd ); return false; }
+			madvise( map, size, MADV_SEQUENTIAL );
+			data = (const char*)map;
+		}
+		::close( fd );
+		return true;
+#else
+		close();
+		std::ifstream in( file.c_str(), std::ios::binary );
+		if( !in.is_open() ){ return false; }
+		buffer.assign( std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() );
+		data = buffer.data(); size = buffer.size();
+		return true;
+#endif
+	}
 
-	std::vector<Vec3f> temp_normals;
-	std::vector<Vec3f> temp_verts;
-	std::vector<Vec3f> temp_colors;
+private:
+#ifndef _WIN32
+	void *map = nullptr;
+#else
+	std::string buffer;
+#endif
+};
 
-	//
-	//	First loop, make buffers
-	//
-	std::ifstream infile( file.c_str() );
-	if( infile.is_open() ){
-		std::string line;
-		while( std::getline( infile, line ) ){
-
-			std::stringstream ss(line);
-			std::string tok; ss >> tok;
-
-			// Vertex
-			if( tok == "v" ){
-
-				// First three location
-				float x, y, z; ss >> x >> y >> z;
-				temp_verts.push_back( Vec3f(x,y,z) );
-
-				// Next three colors
-				float cx, cy, cz;
-				if (ss >> cx >> cy >> cz) {
-					temp_colors.push_back(Vec3f(cx, cy, cz));
-				} else {
-					temp_colors.push_back( Vec3f(0.3f,0.3f,0.3f) );
-				}
-			}
+// The parse_* helpers read from p without going past end,
+// and leave p just after whatever they read.
+static inline void skip_blanks( const char *&p, const char *end ){
+	while( p < end && (*p == ' ' || *p == '\t') ){ ++p; }
+}
 
-			// Normal
-			if( tok == "vn" ){
-				float x, y, z; ss >> x >> y >> z;
-				temp_normals.push_back( Vec3f(x,y,z) );
-			}
-		} // end loop lines
+static inline void skip_line( const char *&p, const char *end ){
+	while( p < end && *p != '\n' ){ ++p; }
+	if( p < end ){ ++p; }
+}
 
-	} // end load obj
-	else { std::cerr << "\n**TriMesh::load_obj Error: Could not open file " << file << std::endl; return false; }
+static inline bool parse_int( const char *&p, const char *end, int &out ){
+	bool neg = false;
+	if( p < end && (*p == '-' || *p == '+') ){ neg = (*p == '-'); ++p; }
+	if( p >= end || *p < '0' || *p > '9' ){ return false; }
+	int v = 0;
+	while( p < end && *p >= '0' && *p <= '9' ){ v = v*10 + (*p - '0'); ++p; }
+	out = neg ? -v : v;
+	return true;
+}
 
-	//
-	//	Second loop, make faces
-	//
-	std::ifstream infile2( file.c_str() );
-	if( infile2.is_open() ){
+// Plain decimal floats with an optional exponent, which is all OBJ files use.
+// Not always the exact same rounding as strtof, but within a float ulp or so.
+static inline bool parse_float( const char *&p, const char *end, float &out ){
+	skip_blanks( p, end );
+	const char *start = p;
+	bool neg = false;
+	if( p < end && (*p == '-' || *p == '+') ){ neg = (*p == '-'); ++p; }
+
+	uint64_t mant = 0; int digits = 0, exp10 = 0;
+	bool any = false;
+	while( p < end && *p >= '0' && *p <= '9' ){
+		if( digits < 19 ){ mant = mant*10 + (*p - '0'); if( mant ){ ++digits; } }
+		else { ++exp10; }
+		++p; any = true;
+	}
+	if( p < end && *p == '.' ){
+		++p;
+		while( p < end && *p >= '0' && *p <= '9' ){
+			if( digits < 19 ){ mant = mant*10 + (*p - '0'); if( mant ){ ++digits; } --exp10; }
+			++p; any = true;
+		}
+	}
+	if( !any ){ p = start; return false; }
+	if( p < end && (*p == 'e' || *p == 'E') ){
+		const char *e = p + 1; int ev;
+		if( parse_int( e, end, ev ) ){ exp10 += ev; p = e; }
+	}
 
-		std::string line;
-		Vec3f curr_color = Vec3f(-1, 0, 0);
-		while( std::getline( infile2, line ) ){
+	double v = (double)mant;
+	if( exp10 < 0 ){ v /= std::pow( 10.0, -exp10 ); }
+	else if( exp10 > 0 ){ v *= std::pow( 10.0, exp10 ); }
+	out = (float)(neg ? -v : v);
+	return true;
+}
 
-			std::stringstream ss(line);
-			std::string tok; ss >> tok;
+// One corner of an "f" line: v, v/t, v//n or v/t/n.
+// Indices come back 0 based, -1 if missing. Negative ones count back from count.
+static inline bool parse_corner( const char *&p, const char *end, int nv, int nn, int &v, int &n ){
+	skip_blanks( p, end );
+	if( !parse_int( p, end, v ) ){ return false; }
+	v = v < 0 ? nv + v : v - 1;
+	n = -1;
+	if( p < end && *p == '/' ){
+		++p; int t;
+		parse_int( p, end, t ); // texture coords aren't used
+		if( p < end && *p == '/' ){
+			++p;
+			if( parse_int( p, end, n ) ){ n = n < 0 ? nn + n : n - 1; }
+			else { n = -1; }
+		}
+	}
+	while( p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' ){ ++p; }
+	return true;
+}
 
-			if (tok == "c")
-			{
-				float cx, cy, cz; ss >> cx >> cy >> cz;
-				curr_color = Vec3f(cx, cy, cz);
-			}
+// What makes a vertex unique: its position, its normal and
+// which color it gets (-1 for the color on its "v" line, otherwise the "c" line in effect).
+struct ObjCorner {
+	int v, n, c;
+	bool operator==( const ObjCorner &o ) const { return v == o.v && n == o.n && c == o.c; }
+};
 
-			// Face
-			if( tok == "f" ){
-				Vec3i face;
-				// Get the three vertices
-				for( size_t i=0; i<3; ++i ){
-					
-					std::string f_str; ss >> f_str;
-					std::vector<std::string> f_vals;
-					split_str( '/', f_str, &f_vals );
-					assert(f_vals.size()>0);
-
-					face[i] = vertices.size();
-					int v_idx = std::stoi(f_vals[0])-1;
-					vertices.push_back( temp_verts[v_idx] );
-					if (curr_color[0] < 0) colors.push_back(temp_colors[v_idx]);
-					else colors.push_back(curr_color);
-
-					// Check for normal
-					if( f_vals.size()>2 ){
-						int n_idx = std::stoi(f_vals[2])-1;
-						normals.push_back( temp_normals[n_idx] );
-					}
-				}
+struct ObjCornerHash {
+	size_t operator()( const ObjCorner &k ) const {
+		uint64_t h = (uint64_t)(uint32_t)k.v * 0x9E3779B97F4A7C15ULL;
+		h ^= (uint64_t)(uint32_t)k.n * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+		h ^= (uint64_t)(uint32_t)k.c * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+		return (size_t)(h ^ (h >> 29));
+	}
+};
 
-				faces.push_back(face);
+bool TriMesh::load_obj( std::string file ){
 
-				// If it's a quad, make another triangle
-				std::string last_vert="";
-				if( ss >> last_vert ){
+	std::cout << "\nLoading " << file << std::endl;
 
-					Vec3i face2;
-					face2[0] = face[0];
-					face2[1] = face[2];
-					face2[2] = vertices.size();
+	//	README:
+	//
+	//	OBJ faces give separate indices for positions and normals,
+	//	but opengl only has one index per vertex. Every distinct
+	//	(position, normal, color) a face uses becomes one vertex,
+	//	and faces that use the same one share it.
+	//
+	//	It's all done in one pass over the file, so "v" and "vn"
+	//	lines have to come before the faces that use them
+	//	(which every exporter does anyway).
+	//
 
-					std::vector<std::string> f_vals;
-					split_str( '/', last_vert, &f_vals );
-					assert(f_vals.size()>0);
+	MappedFile mf;
+	if( !mf.open( file ) ){ std::cerr << "\n**TriMesh::load_obj Error: Could not open file " << file << std::endl; return false; }
 
-					int v_idx = std::stoi(f_vals[0])-1;
+	std::vector<Vec3f> temp_normals;
+	std::vector<Vec3f> temp_verts;
+	std::vector<Vec3f> temp_colors;
+	std::vector<Vec3f> face_colors; // from "c" lines
+
+	std::unordered_map<ObjCorner, int, ObjCornerHash> corner_ids;
+	corner_ids.reserve( mf.size / 64 );
+
+	int curr_color = -1;
+	bool missing_normals = false;
+	std::vector<char> has_normal; // per vertex, whether the file gave it one
+	size_t num_corners = 0;
+	std::vector<int> poly; // vertex ids of the face being read
+
+	const char *p = mf.data, *end = mf.data + mf.size;
+	while( p < end ){
+
+		skip_blanks( p, end );
+		const char *tok = p;
+		while( p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' ){ ++p; }
+		size_t tok_len = p - tok;
+
+		// Vertex
+		if( tok_len == 1 && tok[0] == 'v' ){
+
+			// First three location
+			float x = 0, y = 0, z = 0;
+			parse_float( p, end, x ); parse_float( p, end, y ); parse_float( p, end, z );
+			temp_verts.push_back( Vec3f(x,y,z) );
+
+			// Next three colors
+			float cx, cy, cz;
+			if( parse_float( p, end, cx ) && parse_float( p, end, cy ) && parse_float( p, end, cz ) ){
+				temp_colors.push_back( Vec3f(cx, cy, cz) );
+			} else {
+				temp_colors.push_back( Vec3f(0.3f,0.3f,0.3f) );
+			}
+		}
+
+		// Normal
+		else if( tok_len == 2 && tok[0] == 'v' && tok[1] == 'n' ){
+			float x = 0, y = 0, z = 0;
+			parse_float( p, end, x ); parse_float( p, end, y ); parse_float( p, end, z );
+			temp_normals.push_back( Vec3f(x,y,z) );
+		}
+
+		// Color for the faces after it
+		else if( tok_len == 1 && tok[0] == 'c' ){
+			float cx = 0, cy = 0, cz = 0;
+			parse_float( p, end, cx ); parse_float( p, end, cy ); parse_float( p, end, cz );
+			face_colors.push_back( Vec3f(cx, cy, cz) );
+			curr_color = face_colors.size() - 1;
+		}
+
+		// Face, anything past a triangle gets fanned out from the first corner
+		else if( tok_len == 1 && tok[0] == 'f' ){
+			poly.clear();
+			int v_idx, n_idx;
+			const int nv = temp_verts.size(), nn = temp_normals.size();
+			while( parse_corner( p, end, nv, nn, v_idx, n_idx ) ){
+				if( v_idx < 0 || v_idx >= nv ){
+					std::cerr << "\n**TriMesh::load_obj Error: Bad vertex index in " << file << std::endl;
+					return false;
+				}
+				if( n_idx >= nn ){ n_idx = -1; }
+				if( n_idx < 0 ){ missing_normals = true; }
+				++num_corners;
+
+				ObjCorner key = { v_idx, n_idx, curr_color };
+				auto it = corner_ids.find( key );
+				if( it == corner_ids.end() ){
+					int id = vertices.size();
 					vertices.push_back( temp_verts[v_idx] );
-					if (curr_color[0] < 0) colors.push_back(temp_colors[v_idx]);
-					else colors.push_back(curr_color);
-
-					// Check for normal
-					if( f_vals.size()>2 ){
-						int n_idx = std::stoi(f_vals[2])-1;
-						normals.push_back( temp_normals[n_idx] );
-					}
-
-					faces.push_back(face2);
+					colors.push_back( curr_color < 0 ? temp_colors[v_idx] : face_colors[curr_color] );
+					normals.push_back( n_idx < 0 ? Vec3f() : temp_normals[n_idx] );
+					has_normal.push_back( n_idx >= 0 );
+					it = corner_ids.emplace( key, id ).first;
 				}
+				poly.push_back( it->second );
+			}
+
+			for( size_t i = 2; i < poly.size(); ++i ){
+				faces.push_back( Vec3i(poly[0], poly[i-1], poly[i]) );
+			}
+		} // end parse face
 
-			} // end parse face
+		skip_line( p, end );
 
-		} // end loop lines
+	} // end loop lines
 
-	} // end load obj
+	std::cout << num_corners << " face corners share " << vertices.size() << " vertices" << std::endl;
 
-	// Make sure we have normals
-	if( !normals.size() ){
-		std::cout << "**Warning: normals not loaded so we'll compute them instead." << std::endl;
-		need_normals();
+	// Fill in normals for the vertices whose corners didn't have a "vn",
+	// the ones from the file are kept as they are
+	if( missing_normals ){
+		std::cout << "**Warning: some normals not loaded so we'll compute those instead." << std::endl;
+		std::vector<Vec3f> loaded;
+		loaded.swap( normals );
+		need_normals( true );
+		for( size_t i = 0; i < normals.size(); ++i ){
+			if( has_normal[i] ){ normals[i] = loaded[i]; }
+		}
 	}
 
 	return true;
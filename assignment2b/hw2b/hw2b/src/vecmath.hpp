@@ -0,0 +1,322 @@
+// 4x4 matrices and quaternions for the viewer, the matrix work done four floats at a time.
+// Matrices are row major (m[row*4 + col]) and go to OpenGL with transpose = GL_TRUE.
+
+#ifndef VECMATH_HPP
+#define VECMATH_HPP 1
+
+#include "trimesh.hpp"
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VECMATH_SSE 1
+#endif
+
+//
+//	Rotation as a unit quaternion, w is the real part
+//
+class Quat {
+public:
+	float x, y, z, w;
+
+	Quat() : x(0.f), y(0.f), z(0.f), w(1.f) {} // Default: no rotation
+	Quat( float x_, float y_, float z_, float w_ ) : x(x_), y(y_), z(z_), w(w_) {}
+
+	// Right handed rotation by angle (radians) around axis (doesn't need to be unit length)
+	static Quat axis_angle( Vec3f axis, float angle );
+
+	Quat conjugate() const { return Quat( -x, -y, -z, w ); }
+	void normalize();
+
+	// v rotated by this (which has to be unit length)
+	Vec3f rotate( const Vec3f &v ) const;
+};
+
+// Rotation by b, then by a
+static inline const Quat operator*( const Quat &a, const Quat &b ){
+	return Quat(
+		a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y,
+		a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x,
+		a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w,
+		a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z );
+}
+
+//
+//	4x4 Matrix Class
+//	Vectors are columns, so a * b applies b first.
+//
+class Mat4x4 {
+public:
+
+	float m[16];
+
+	Mat4x4(){ make_identity(); } // Default: Identity
+
+	void make_identity(){
+		m[0]  = 1.f; m[1]  = 0.f; m[2]  = 0.f; m[3]  = 0.f;
+		m[4]  = 0.f; m[5]  = 1.f; m[6]  = 0.f; m[7]  = 0.f;
+		m[8]  = 0.f; m[9]  = 0.f; m[10] = 1.f; m[11] = 0.f;
+		m[12] = 0.f; m[13] = 0.f; m[14] = 0.f; m[15] = 1.f;
+	}
+
+	void print() const {
+		printf(
+			"| % 6.2f % 6.2f % 6.2f % 6.2f |\n| % 6.2f % 6.2f % 6.2f % 6.2f |\n| % 6.2f % 6.2f % 6.2f % 6.2f |\n| % 6.2f % 6.2f % 6.2f % 6.2f |\n",
+			m[0], m[1], m[2], m[3],
+			m[4], m[5], m[6], m[7],
+			m[8], m[9], m[10], m[11],
+			m[12], m[13], m[14], m[15]
+		);
+	}
+
+	void make_scale( float x, float y, float z ){
+		make_identity();
+		m[0] = x; m[5] = y; m[10] = z;
+	}
+
+	void make_translation( float x, float y, float z ){
+		make_identity();
+		m[3] = x; m[7] = y; m[11] = z;
+	}
+
+	// q has to be unit length
+	void make_rotation( const Quat &q );
+
+	// View matrix for a camera at eye looking at target (gluLookAt)
+	void make_look_at( const Vec3f &eye, const Vec3f &target, const Vec3f &up );
+
+	// Perspective projection with the near plane spanning left..right, bottom..top (glFrustum)
+	void make_frustum( float left, float right, float bottom, float top, float near, float far );
+
+	// Symmetric perspective projection, fovy in radians (gluPerspective)
+	void make_perspective( float fovy, float aspect, float near, float far );
+
+	// Fills this from a column major array (like the instance matrices)
+	void load_column_major( const float c[16] );
+
+	Mat4x4 transposed() const;
+
+	// Sets out to the inverse, false (and out untouched) if there isn't one
+	bool inverse( Mat4x4 &out ) const;
+
+	// p with w = 1, no divide by w afterwards
+	Vec3f transform_point( const Vec3f &p ) const {
+		return Vec3f( m[0]*p[0] + m[1]*p[1] + m[2]*p[2] + m[3],
+			m[4]*p[0] + m[5]*p[1] + m[6]*p[2] + m[7],
+			m[8]*p[0] + m[9]*p[1] + m[10]*p[2] + m[11] );
+	}
+
+	// d with w = 0, so no translation
+	Vec3f transform_dir( const Vec3f &d ) const {
+		return Vec3f( m[0]*d[0] + m[1]*d[1] + m[2]*d[2],
+			m[4]*d[0] + m[5]*d[1] + m[6]*d[2],
+			m[8]*d[0] + m[9]*d[1] + m[10]*d[2] );
+	}
+};
+
+static inline const Mat4x4 operator*( const Mat4x4 &a, const Mat4x4 &b );
+
+static inline const Vec3f operator*( const Mat4x4 &m, const Vec3f &p ){ return m.transform_point( p ); }
+
+
+
+//
+//	Implementation
+//
+
+Quat Quat::axis_angle( Vec3f axis, float angle ){
+	axis.normalize();
+	float s = std::sin( 0.5f * angle );
+	return Quat( axis[0] * s, axis[1] * s, axis[2] * s, std::cos( 0.5f * angle ) );
+}
+
+void Quat::normalize(){
+	float l = std::sqrt( x*x + y*y + z*z + w*w );
+	if( l <= 0.f ){ return; }
+	x /= l; y /= l; z /= l; w /= l;
+}
+
+Vec3f Quat::rotate( const Vec3f &v ) const {
+	// v + w*t + q x t with t = 2 (q x v), two cross products instead of building the matrix
+	Vec3f q( x, y, z );
+	Vec3f t = q.cross( v ); t *= 2.f;
+	Vec3f r = v;
+	r += t * w;
+	r += q.cross( t );
+	return r;
+}
+
+void Mat4x4::make_rotation( const Quat &q ){
+	float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+	float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+	float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+	make_identity();
+	m[0] = 1.f - 2.f*(yy + zz); m[1] = 2.f*(xy - wz);       m[2]  = 2.f*(xz + wy);
+	m[4] = 2.f*(xy + wz);       m[5] = 1.f - 2.f*(xx + zz); m[6]  = 2.f*(yz - wx);
+	m[8] = 2.f*(xz - wy);       m[9] = 2.f*(yz + wx);       m[10] = 1.f - 2.f*(xx + yy);
+}
+
+void Mat4x4::make_look_at( const Vec3f &eye, const Vec3f &target, const Vec3f &up ){
+	// rows are the camera's right, up and backwards directions (u, v, n)
+	Vec3f n = eye - target; n.normalize();
+	Vec3f u = up.cross( n ); u.normalize();
+	Vec3f v = n.cross( u ); v.normalize();
+	m[0]  = u[0]; m[1]  = u[1]; m[2]  = u[2]; m[3]  = -eye.dot( u );
+	m[4]  = v[0]; m[5]  = v[1]; m[6]  = v[2]; m[7]  = -eye.dot( v );
+	m[8]  = n[0]; m[9]  = n[1]; m[10] = n[2]; m[11] = -eye.dot( n );
+	m[12] = 0.f;  m[13] = 0.f;  m[14] = 0.f;  m[15] = 1.f;
+}
+
+void Mat4x4::make_frustum( float left, float right, float bottom, float top, float near, float far ){
+	float ttn = 2.f * near;
+	m[0]  = ttn / (right - left); m[1]  = 0.f; m[2]  = (right + left) / (right - left); m[3]  = 0.f;
+	m[4]  = 0.f; m[5]  = ttn / (top - bottom); m[6]  = (top + bottom) / (top - bottom); m[7]  = 0.f;
+	m[8]  = 0.f; m[9]  = 0.f; m[10] = -(far + near) / (far - near); m[11] = -(ttn * far) / (far - near);
+	m[12] = 0.f; m[13] = 0.f; m[14] = -1.f; m[15] = 0.f;
+}
+
+void Mat4x4::make_perspective( float fovy, float aspect, float near, float far ){
+	float top = near * std::tan( 0.5f * fovy );
+	make_frustum( -top * aspect, top * aspect, -top, top, near, far );
+}
+
+void Mat4x4::load_column_major( const float c[16] ){
+	for( int r = 0; r < 4; ++r ){
+		for( int k = 0; k < 4; ++k ){ m[4*r + k] = c[4*k + r]; }
+	}
+}
+
+#ifdef VECMATH_SSE
+namespace vecmath {
+
+	#define VECMATH_SHUFFLE( a, b, x, y, z, w ) _mm_shuffle_ps( a, b, _MM_SHUFFLE( w, z, y, x ) )
+	#define VECMATH_SWIZZLE( a, x, y, z, w ) VECMATH_SHUFFLE( a, a, x, y, z, w )
+
+	// The inverse below works on the four 2x2 blocks of the matrix,
+	// each held row major in one register (a00 a01 a10 a11)
+
+	// a * b
+	static inline __m128 mat2_mul( __m128 a, __m128 b ){
+		return _mm_add_ps( _mm_mul_ps( a, VECMATH_SWIZZLE( b, 0, 3, 0, 3 ) ),
+			_mm_mul_ps( VECMATH_SWIZZLE( a, 1, 0, 3, 2 ), VECMATH_SWIZZLE( b, 2, 1, 2, 1 ) ) );
+	}
+
+	// adjugate(a) * b
+	static inline __m128 mat2_adj_mul( __m128 a, __m128 b ){
+		return _mm_sub_ps( _mm_mul_ps( VECMATH_SWIZZLE( a, 3, 3, 0, 0 ), b ),
+			_mm_mul_ps( VECMATH_SWIZZLE( a, 1, 1, 2, 2 ), VECMATH_SWIZZLE( b, 2, 3, 0, 1 ) ) );
+	}
+
+	// a * adjugate(b)
+	static inline __m128 mat2_mul_adj( __m128 a, __m128 b ){
+		return _mm_sub_ps( _mm_mul_ps( a, VECMATH_SWIZZLE( b, 3, 0, 3, 0 ) ),
+			_mm_mul_ps( VECMATH_SWIZZLE( a, 1, 0, 3, 2 ), VECMATH_SWIZZLE( b, 2, 1, 2, 1 ) ) );
+	}
+
+} // end namespace vecmath
+#endif
+
+static inline const Mat4x4 operator*( const Mat4x4 &a, const Mat4x4 &b ){
+	Mat4x4 r;
+#ifdef VECMATH_SSE
+	// each row of r is a's row weighting b's rows
+	__m128 b0 = _mm_loadu_ps( b.m ), b1 = _mm_loadu_ps( b.m + 4 ), b2 = _mm_loadu_ps( b.m + 8 ), b3 = _mm_loadu_ps( b.m + 12 );
+	for( int i = 0; i < 4; ++i ){
+		const float *ar = a.m + 4*i;
+		__m128 row = _mm_add_ps(
+			_mm_add_ps( _mm_mul_ps( _mm_set1_ps( ar[0] ), b0 ), _mm_mul_ps( _mm_set1_ps( ar[1] ), b1 ) ),
+			_mm_add_ps( _mm_mul_ps( _mm_set1_ps( ar[2] ), b2 ), _mm_mul_ps( _mm_set1_ps( ar[3] ), b3 ) ) );
+		_mm_storeu_ps( r.m + 4*i, row );
+	}
+#else
+	for( int i = 0; i < 4; ++i ){
+		for( int j = 0; j < 4; ++j ){
+			r.m[4*i + j] = a.m[4*i]*b.m[j] + a.m[4*i + 1]*b.m[4 + j] + a.m[4*i + 2]*b.m[8 + j] + a.m[4*i + 3]*b.m[12 + j];
+		}
+	}
+#endif
+	return r;
+}
+
+Mat4x4 Mat4x4::transposed() const {
+	Mat4x4 r;
+#ifdef VECMATH_SSE
+	__m128 r0 = _mm_loadu_ps( m ), r1 = _mm_loadu_ps( m + 4 ), r2 = _mm_loadu_ps( m + 8 ), r3 = _mm_loadu_ps( m + 12 );
+	_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+	_mm_storeu_ps( r.m, r0 ); _mm_storeu_ps( r.m + 4, r1 ); _mm_storeu_ps( r.m + 8, r2 ); _mm_storeu_ps( r.m + 12, r3 );
+#else
+	r.load_column_major( m );
+#endif
+	return r;
+}
+
+bool Mat4x4::inverse( Mat4x4 &out ) const {
+#ifdef VECMATH_SSE
+	using namespace vecmath;
+	// Blockwise with 2x2 adjugates: for M = | A B |, the inverse is 1/|M| | X Y |
+	//                                       | C D |                      | Z W |
+	__m128 r0 = _mm_loadu_ps( m ), r1 = _mm_loadu_ps( m + 4 ), r2 = _mm_loadu_ps( m + 8 ), r3 = _mm_loadu_ps( m + 12 );
+	__m128 A = _mm_movelh_ps( r0, r1 ), B = _mm_movehl_ps( r1, r0 );
+	__m128 C = _mm_movelh_ps( r2, r3 ), D = _mm_movehl_ps( r3, r2 );
+
+	// |A| |B| |C| |D|
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps( VECMATH_SHUFFLE( r0, r2, 0, 2, 0, 2 ), VECMATH_SHUFFLE( r1, r3, 1, 3, 1, 3 ) ),
+		_mm_mul_ps( VECMATH_SHUFFLE( r0, r2, 1, 3, 1, 3 ), VECMATH_SHUFFLE( r1, r3, 0, 2, 0, 2 ) ) );
+	__m128 det_a = VECMATH_SWIZZLE( det_sub, 0, 0, 0, 0 ), det_b = VECMATH_SWIZZLE( det_sub, 1, 1, 1, 1 );
+	__m128 det_c = VECMATH_SWIZZLE( det_sub, 2, 2, 2, 2 ), det_d = VECMATH_SWIZZLE( det_sub, 3, 3, 3, 3 );
+
+	__m128 d_c = mat2_adj_mul( D, C ); // adj(D) C
+	__m128 a_b = mat2_adj_mul( A, B ); // adj(A) B
+
+	// adjugates of the blocks of the result
+	__m128 X = _mm_sub_ps( _mm_mul_ps( det_d, A ), mat2_mul( B, d_c ) );
+	__m128 W = _mm_sub_ps( _mm_mul_ps( det_a, D ), mat2_mul( C, a_b ) );
+	__m128 Y = _mm_sub_ps( _mm_mul_ps( det_b, C ), mat2_mul_adj( D, a_b ) );
+	__m128 Z = _mm_sub_ps( _mm_mul_ps( det_c, B ), mat2_mul_adj( A, d_c ) );
+
+	// |M| = |A||D| + |B||C| - tr( adj(A) B adj(D) C )
+	__m128 tr = _mm_mul_ps( a_b, VECMATH_SWIZZLE( d_c, 0, 2, 1, 3 ) );
+	tr = _mm_add_ps( tr, VECMATH_SWIZZLE( tr, 2, 3, 0, 1 ) );
+	tr = _mm_add_ps( tr, VECMATH_SWIZZLE( tr, 1, 0, 3, 2 ) );
+	__m128 det = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( det_a, det_d ), _mm_mul_ps( det_b, det_c ) ), tr );
+	if( _mm_cvtss_f32( det ) == 0.f ){ return false; }
+
+	// undoing the adjugates flips the sign of the off diagonals
+	__m128 inv_det = _mm_div_ps( _mm_setr_ps( 1.f, -1.f, -1.f, 1.f ), det );
+	X = _mm_mul_ps( X, inv_det ); Y = _mm_mul_ps( Y, inv_det );
+	Z = _mm_mul_ps( Z, inv_det ); W = _mm_mul_ps( W, inv_det );
+
+	_mm_storeu_ps( out.m, VECMATH_SHUFFLE( X, Y, 3, 1, 3, 1 ) );
+	_mm_storeu_ps( out.m + 4, VECMATH_SHUFFLE( X, Y, 2, 0, 2, 0 ) );
+	_mm_storeu_ps( out.m + 8, VECMATH_SHUFFLE( Z, W, 3, 1, 3, 1 ) );
+	_mm_storeu_ps( out.m + 12, VECMATH_SHUFFLE( Z, W, 2, 0, 2, 0 ) );
+	return true;
+#else
+	// Cofactors along the first row, then the rest of the adjugate
+	float inv[16];
+	inv[0]  =  m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+	inv[4]  = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+	inv[8]  =  m[4]*m[9]*m[15]  - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+	inv[12] = -m[4]*m[9]*m[14]  + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+	float det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+	if( det == 0.f ){ return false; }
+	inv[1]  = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+	inv[5]  =  m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+	inv[9]  = -m[0]*m[9]*m[15]  + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+	inv[13] =  m[0]*m[9]*m[14]  - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+	inv[2]  =  m[1]*m[6]*m[15]  - m[1]*m[7]*m[14]  - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7]  - m[13]*m[3]*m[6];
+	inv[6]  = -m[0]*m[6]*m[15]  + m[0]*m[7]*m[14]  + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7]  + m[12]*m[3]*m[6];
+	inv[10] =  m[0]*m[5]*m[15]  - m[0]*m[7]*m[13]  - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7]  - m[12]*m[3]*m[5];
+	inv[14] = -m[0]*m[5]*m[14]  + m[0]*m[6]*m[13]  + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6]  + m[12]*m[2]*m[5];
+	inv[3]  = -m[1]*m[6]*m[11]  + m[1]*m[7]*m[10]  + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7]   + m[9]*m[3]*m[6];
+	inv[7]  =  m[0]*m[6]*m[11]  - m[0]*m[7]*m[10]  - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7]   - m[8]*m[3]*m[6];
+	inv[11] = -m[0]*m[5]*m[11]  + m[0]*m[7]*m[9]   + m[4]*m[1]*m[11] - m[4]*m[3]*m[9]  - m[8]*m[1]*m[7]   + m[8]*m[3]*m[5];
+	inv[15] =  m[0]*m[5]*m[10]  - m[0]*m[6]*m[9]   - m[4]*m[1]*m[10] + m[4]*m[2]*m[9]  + m[8]*m[1]*m[6]   - m[8]*m[2]*m[5];
+	for( int i = 0; i < 16; ++i ){ out.m[i] = inv[i] / det; }
+	return true;
+#endif
+}
+
+#endif